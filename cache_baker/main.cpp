@@ -0,0 +1,277 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Fills the cache ahead of time, so that the game doesn't have to on the first run.
+ * The input is a directory holding the unpacked SFS files - it takes the place
+ * of the game directory, so the cache ends up in the same place the game uses.
+ */
+
+#include "ressource_loader.h"
+#include "baked_map_cache.h"
+#include <sfs.h>
+#include <il2ge/map_loader.h>
+#include <il2ge/thread_pool.h>
+#include <render_util/land_textures.h>
+#include <util.h>
+#include <log.h>
+
+#include <atmosphere_map.h>
+#include <curvature_map.h>
+
+#include <filesystem>
+#include <functional>
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+using namespace std;
+using Clock = std::chrono::steady_clock;
+
+namespace fs = std::filesystem;
+
+
+namespace il2ge::map_loader
+{
+  bool isDumpEnabled() { return false; }
+}
+
+
+namespace
+{
+
+
+// logs how long func took - returns false if func failed
+bool runTimed(const string &name, const function<bool()> &func)
+{
+  LOG_INFO << name << " ..." << endl;
+
+  auto start_time = Clock::now();
+
+  bool success = false;
+
+  try
+  {
+    success = func();
+  }
+  catch (std::exception &e)
+  {
+    LOG_ERROR << name << ": " << e.what() << endl;
+  }
+
+  auto ms = chrono::duration_cast<chrono::milliseconds>(Clock::now() - start_time).count();
+
+  if (success)
+    LOG_INFO << name << ": done in " << ms << " ms" << endl;
+  else
+    LOG_ERROR << name << ": failed after " << ms << " ms" << endl;
+
+  return success;
+}
+
+
+// like core::init(), but files of the right size are considered up to date
+bool bakeFile(const char *path, size_t size, const function<bool(const char*)> &generate_func)
+{
+  struct stat stat_res;
+
+  if (stat(path, &stat_res) == 0 && size_t(stat_res.st_size) == size)
+  {
+    LOG_INFO << path << " is up to date." << endl;
+    return true;
+  }
+
+  return generate_func(path);
+}
+
+
+// finds the entry in dir with the given (lowercase) name, ignoring case
+bool findEntry(const fs::path &dir, const string &name, fs::path &path)
+{
+  std::error_code error;
+
+  for (fs::directory_iterator it(dir, error); !error && it != fs::directory_iterator();
+       it.increment(error))
+  {
+    if (util::makeLowercase(it->path().filename().string()) == name)
+    {
+      path = it->path();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+// load.ini paths relative to maps/, as used by core::loadMap()
+vector<string> findMaps()
+{
+  vector<string> maps;
+
+  fs::path maps_dir;
+  if (!findEntry(".", "maps", maps_dir))
+    return maps;
+
+  std::error_code error;
+
+  for (fs::directory_iterator it(maps_dir, error); !error && it != fs::directory_iterator();
+       it.increment(error))
+  {
+    fs::path ini_path;
+    if (it->is_directory() && findEntry(it->path(), "load.ini", ini_path))
+      maps.push_back(it->path().filename().string() + '/' + ini_path.filename().string());
+  }
+
+  sort(maps.begin(), maps.end());
+
+  return maps;
+}
+
+
+// the baked map and the normal maps
+bool bakeMap(const string &path)
+{
+  // same as core::Map
+  string map_dir = "maps/" + path.substr(0, path.find_last_of('/')) + '/';
+  string ini_path = "maps/" + path;
+
+  long ini_size = 0;
+  if (!sfs::getFileSize(ini_path, ini_size))
+  {
+    LOG_ERROR << ini_path << " not found" << endl;
+    return false;
+  }
+
+  core::RessourceLoader loader(map_dir, ini_path, {});
+
+  auto baked_map_path = core::getBakedMapPath(ini_path);
+  auto baked_map_key = core::getBakedMapKey(loader);
+
+  il2ge::map_loader::BakedMap baked_map;
+
+  bool is_cached = il2ge::map_loader::loadBakedMap(baked_map_path, baked_map_key, baked_map);
+  if (!is_cached)
+    il2ge::map_loader::bakeMap(&loader, baked_map);
+
+  // bakes the normal maps and creates the far texture
+  render_util::LandTextures land_textures;
+  il2ge::map_loader::createLandTextures(&loader, baked_map, land_textures, true);
+
+  if (!is_cached && !core::saveBakedMapToCache(baked_map_path, baked_map_key, baked_map))
+  {
+    LOG_ERROR << "Failed to write " << baked_map_path << endl;
+    return false;
+  }
+
+  return true;
+}
+
+
+} // namespace
+
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    cerr << "Usage: il2ge_cache_baker <directory with the unpacked SFS files> [map ...]" << endl;
+    cerr << "map: path of the map's load.ini relative to maps/ - default: all maps" << endl;
+    return 1;
+  }
+
+  auto start_time = Clock::now();
+
+  // the cache location is relative to the game directory
+  std::error_code error;
+  fs::current_path(argv[1], error);
+  if (error)
+  {
+    cerr << "Can't change to " << argv[1] << ": " << error.message() << endl;
+    return 1;
+  }
+
+  try
+  {
+    sfs::setBackend(sfs::createDirectoryBackend("."));
+  }
+  catch (std::exception &e)
+  {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
+  vector<string> maps(argv + 2, argv + argc);
+  if (maps.empty())
+    maps = findMaps();
+
+  auto res = util::mkdir(IL2GE_CACHE_DIR);
+  assert(res);
+
+  atomic<int> num_items = 0;
+  atomic<int> num_failed = 0;
+
+  auto run = [&] (const string &name, const function<bool()> &func)
+  {
+    num_items++;
+    if (!runTimed(name, func))
+      num_failed++;
+  };
+
+  {
+    // these don't use SFS, so they can be generated while the maps are being baked
+    il2ge::ThreadPool pool(2);
+
+    pool.submit([&]
+    {
+      run("atmosphere_map", []
+      {
+        return bakeFile(IL2GE_CACHE_DIR "/atmosphere_map", atmosphere_map_size_bytes,
+                        render_util::createAtmosphereMap);
+      });
+    });
+
+    pool.submit([&]
+    {
+      run("curvature_map", []
+      {
+        return bakeFile(IL2GE_CACHE_DIR "/curvature_map", curvature_map_size_bytes,
+                        render_util::createCurvatureMap);
+      });
+    });
+
+    // SFS is only accessed from this thread - the map loader uses its own pools
+    for (auto &map : maps)
+      run(map, [&map] { return bakeMap(map); });
+
+    pool.wait();
+  }
+
+  auto seconds = chrono::duration_cast<chrono::seconds>(Clock::now() - start_time).count();
+
+  LOG_INFO << "baked " << num_items << " items in " << seconds << " s, "
+           << num_failed << " failed" << endl;
+
+  return num_failed ? 1 : 0;
+}
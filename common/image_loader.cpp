@@ -21,8 +21,12 @@
 #include <render_util/image_loader.h>
 #include <render_util/image.h>
 #include <render_util/image_util.h>
+#include <log.h>
 
 #include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
 
 using namespace std;
 
@@ -37,21 +41,122 @@ const string g_imf_header =
 };
 
 
-bool isIMF(const vector<char> &data)
+constexpr size_t TGA_HEADER_SIZE = 18;
+
+// magic, width and height as 16 bit little endian, number of channels, 3 bytes padding
+constexpr char RAW_MAGIC[8] = { 'I', 'L', '2', 'G', 'E', 'R', 'A', 'W' };
+constexpr size_t RAW_HEADER_SIZE = 16;
+
+
+bool isIMF(const char *data, size_t size)
 {
-  if (data.size() > g_imf_header.size())
-    return g_imf_header.compare(0, string::npos, data.data(), g_imf_header.size()) == 0;
+  if (size > g_imf_header.size())
+    return g_imf_header.compare(0, string::npos, data, g_imf_header.size()) == 0;
   else
     return false;
 }
 
 
+bool isIMF(const vector<char> &data)
+{
+  return isIMF(data.data(), data.size());
+}
+
+
+int getTGANumChannels(int bits, bool is_grey)
+{
+  switch (bits)
+  {
+    case 8:
+      return 1;
+    case 16:
+      if (is_grey)
+        return 2;
+      return 3;
+    case 15:
+    case 24:
+      return 3;
+    case 32:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+
+// TGA has no magic number, so the header fields are checked for plausibility
+bool probeTGA(const char *data, size_t size, il2ge::ImageInfo &info)
+{
+  if (size < TGA_HEADER_SIZE)
+    return false;
+
+  auto header = reinterpret_cast<const unsigned char*>(data);
+
+  int colormap_type = header[1];
+  int image_type = header[2];
+  int colormap_bits = header[7];
+  int width = header[12] | (header[13] << 8);
+  int height = header[14] | (header[15] << 8);
+  int bits = header[16];
+
+  bool is_colormapped = image_type == 1 || image_type == 9;
+  bool is_grey = image_type == 3 || image_type == 11;
+  bool is_rgb = image_type == 2 || image_type == 10;
+
+  if (colormap_type > 1 || !(is_colormapped || is_grey || is_rgb))
+    return false;
+
+  if (is_colormapped != (colormap_type == 1))
+    return false;
+
+  if (width < 1 || height < 1)
+    return false;
+
+  int num_channels = is_colormapped ?
+    getTGANumChannels(colormap_bits, false) :
+    getTGANumChannels(bits, is_grey);
+
+  if (!num_channels)
+    return false;
+
+  info.format = il2ge::ImageFormat::TGA;
+  info.size = glm::ivec2(width, height);
+  info.num_channels = num_channels;
+
+  return true;
+}
+
+
+bool probeRaw(const char *data, size_t size, il2ge::ImageInfo &info)
+{
+  if (size < RAW_HEADER_SIZE || memcmp(data, RAW_MAGIC, sizeof(RAW_MAGIC)) != 0)
+    return false;
+
+  info.format = il2ge::ImageFormat::RAW;
+
+  auto header = reinterpret_cast<const unsigned char*>(data);
+
+  int width = header[8] | (header[9] << 8);
+  int height = header[10] | (header[11] << 8);
+  int num_channels = header[12];
+
+  if (width < 1 || height < 1 || num_channels < 1 || num_channels > 4)
+    return false;
+
+  info.size = glm::ivec2(width, height);
+  info.num_channels = num_channels;
+
+  return true;
+}
+
+
 std::shared_ptr<render_util::GenericImage>
 loadImageFromIMF(const vector<char> &data, const char *field_name)
 {
   vector<unsigned char> rgba_data;
   int width, height;
-  loadIMF(data, rgba_data, width, height, field_name);
+  if (!loadIMF(data, rgba_data, width, height, field_name))
+    return {};
 
   return make_shared<render_util::GenericImage>(glm::ivec2(width, height), std::move(rgba_data), 4);
 }
@@ -62,12 +167,82 @@ loadImageRGBAFromIMF(const vector<char> &data, const char *field_name)
 {
   vector<unsigned char> rgba_data;
   int width, height;
-  loadIMF(data, rgba_data, width, height, field_name);
+  if (!loadIMF(data, rgba_data, width, height, field_name))
+    return {};
 
   return make_shared<render_util::ImageRGBA>(glm::ivec2(width, height), std::move(rgba_data));
 }
 
 
+unsigned char getLuminance(int r, int g, int b)
+{
+  return (r * 77 + g * 150 + b * 29) >> 8;
+}
+
+
+// 1: grey, 2: grey + alpha, 3: RGB, 4: RGBA
+void convertRow(const unsigned char *src, int src_channels,
+                unsigned char *dst, int dst_channels, int width)
+{
+  if (src_channels == dst_channels)
+  {
+    memcpy(dst, src, size_t(width) * src_channels);
+    return;
+  }
+
+  for (int x = 0; x < width; x++)
+  {
+    auto in = src + x * src_channels;
+    auto out = dst + x * dst_channels;
+
+    bool is_grey = src_channels < 3;
+    int r = in[0];
+    int g = is_grey ? in[0] : in[1];
+    int b = is_grey ? in[0] : in[2];
+    int a = 255;
+    if (src_channels == 2)
+      a = in[1];
+    else if (src_channels == 4)
+      a = in[3];
+
+    switch (dst_channels)
+    {
+      case 1:
+        out[0] = is_grey ? r : getLuminance(r, g, b);
+        break;
+      case 2:
+        out[0] = is_grey ? r : getLuminance(r, g, b);
+        out[1] = a;
+        break;
+      case 4:
+        out[3] = a;
+        // fall through
+      case 3:
+        out[0] = r;
+        out[1] = g;
+        out[2] = b;
+        break;
+    }
+  }
+}
+
+
+// rows of src are stored top to bottom
+void copyRows(const unsigned char *src, int src_channels,
+              unsigned char *dst, int dst_channels, glm::ivec2 size, bool flip_y)
+{
+  const size_t src_row_size = size_t(size.x) * src_channels;
+  const size_t dst_row_size = size_t(size.x) * dst_channels;
+
+  for (int y = 0; y < size.y; y++)
+  {
+    int dst_y = flip_y ? size.y - 1 - y : y;
+    convertRow(src + y * src_row_size, src_channels,
+               dst + dst_y * dst_row_size, dst_channels, size.x);
+  }
+}
+
+
 } // namespace
 
 
@@ -106,18 +281,191 @@ bool isIMF(util::File &file)
 }
 
 
-void getIMFInfo(util::File &file, int &w, int &h)
+bool getIMFInfo(util::File &file, int &w, int &h)
 {
   return ::getIMFInfo(file, w, h);
 }
 
 
+bool probeImage(const char *data, size_t size, ImageInfo &info)
+{
+  info = {};
+
+  if (::isIMF(data, size))
+  {
+    info.format = ImageFormat::IMF;
+
+    int w = 0, h = 0;
+    if (!::getIMFInfo(data, size, w, h))
+      return false;
+
+    info.size = glm::ivec2(w, h);
+    info.num_channels = 4;
+
+    return true;
+  }
+
+  if (size >= sizeof(RAW_MAGIC) && memcmp(data, RAW_MAGIC, sizeof(RAW_MAGIC)) == 0)
+    return probeRaw(data, size, info);
+
+  return probeTGA(data, size, info);
+}
+
+
+bool probeImage(const std::vector<char> &data, ImageInfo &info)
+{
+  return probeImage(data.data(), data.size(), info);
+}
+
+
+bool probeImage(util::File &file, ImageInfo &info)
+{
+  char header[max(TGA_HEADER_SIZE, IMF_HEADER_SIZE)] {};
+
+  auto read = file.read(header, sizeof(header));
+
+  file.rewind();
+
+  return read > 0 && probeImage(header, read, info);
+}
+
+
+bool decodeImage(const std::vector<char> &data, unsigned char *dst, size_t dst_size,
+                 const DecodeOptions &options, const char *name)
+{
+  ImageInfo info;
+  if (!probeImage(data, info))
+  {
+    // not known to probeImage() - render_util supports more formats
+    auto image = render_util::loadImageFromMemory<render_util::GenericImage>(data);
+    if (!image)
+    {
+      LOG_ERROR << name << ": unsupported image format" << endl;
+      return false;
+    }
+
+    return copyImage(*image, dst, dst_size, options, name);
+  }
+
+  const int num_channels = options.num_channels ? options.num_channels : info.num_channels;
+  assert(num_channels >= 1 && num_channels <= 4);
+
+  if (dst_size < size_t(info.size.x) * info.size.y * num_channels)
+  {
+    LOG_ERROR << name << ": destination too small" << endl;
+    return false;
+  }
+
+  if (info.format == ImageFormat::IMF)
+  {
+    if (num_channels == 4)
+      return ::decodeIMF(data.data(), data.size(), dst, dst_size, options.flip_y, name);
+
+    vector<unsigned char> rgba(size_t(info.size.x) * info.size.y * 4);
+    if (!::decodeIMF(data.data(), data.size(), rgba.data(), rgba.size(), false, name))
+      return false;
+
+    copyRows(rgba.data(), 4, dst, num_channels, info.size, options.flip_y);
+    return true;
+  }
+
+  if (info.format == ImageFormat::RAW)
+  {
+    const size_t src_size = size_t(info.size.x) * info.size.y * info.num_channels;
+    if (data.size() < RAW_HEADER_SIZE + src_size)
+    {
+      LOG_ERROR << name << ": unexpected end of file" << endl;
+      return false;
+    }
+
+    copyRows(reinterpret_cast<const unsigned char*>(data.data()) + RAW_HEADER_SIZE,
+             info.num_channels, dst, num_channels, info.size, options.flip_y);
+    return true;
+  }
+
+  // other formats are decoded by render_util - this costs one temporary image
+  auto image = render_util::loadImageFromMemory<render_util::GenericImage>(data);
+  if (!image || image->getSize() != info.size)
+  {
+    LOG_ERROR << name << ": failed to decode image" << endl;
+    return false;
+  }
+
+  return copyImage(*image, dst, dst_size, options, name);
+}
+
+
+bool copyImage(const render_util::GenericImage &image, unsigned char *dst, size_t dst_size,
+               const DecodeOptions &options, const char *name)
+{
+  const int num_channels = options.num_channels ? options.num_channels : image.numComponents();
+  assert(num_channels >= 1 && num_channels <= 4);
+
+  if (dst_size < size_t(image.w()) * image.h() * num_channels)
+  {
+    LOG_ERROR << name << ": destination too small" << endl;
+    return false;
+  }
+
+  copyRows(image.getData(), image.numComponents(), dst, num_channels,
+           image.getSize(), options.flip_y);
+
+  return true;
+}
+
+
+std::vector<char> encodeRawImage(const unsigned char *data, glm::ivec2 size, int num_channels)
+{
+  assert(num_channels >= 1 && num_channels <= 4);
+
+  if (size.x < 1 || size.y < 1 || size.x > 0xFFFF || size.y > 0xFFFF)
+    return {};
+
+  const size_t data_size = size_t(size.x) * size.y * num_channels;
+
+  vector<char> out(RAW_HEADER_SIZE + data_size, 0);
+
+  memcpy(out.data(), RAW_MAGIC, sizeof(RAW_MAGIC));
+  out[8] = size.x & 0xFF;
+  out[9] = size.x >> 8;
+  out[10] = size.y & 0xFF;
+  out[11] = size.y >> 8;
+  out[12] = num_channels;
+
+  memcpy(out.data() + RAW_HEADER_SIZE, data, data_size);
+
+  return out;
+}
+
+
 std::unique_ptr<render_util::GenericImage>
 loadIMF(const std::vector<char> &data, int force_channels)
 {
   vector<unsigned char> image_data;
   int width, height;
-  ::loadIMF(data, image_data, width, height, "");
+  if (!::loadIMF(data, image_data, width, height, ""))
+    return {};
+
+  auto image = make_unique<render_util::GenericImage>(glm::ivec2(width, height),
+                                                      std::move(image_data), 4);
+
+  if (force_channels && force_channels != 4)
+  {
+    auto new_image = render_util::image::makeGeneric(image, force_channels);
+    image = std::move(new_image);
+  }
+
+  return image;
+}
+
+
+std::unique_ptr<render_util::GenericImage>
+loadIMF(util::File &file, int force_channels)
+{
+  vector<unsigned char> image_data;
+  int width, height;
+  if (!::loadIMF(file, image_data, width, height, ""))
+    return {};
 
   auto image = make_unique<render_util::GenericImage>(glm::ivec2(width, height),
                                                       std::move(image_data), 4);
@@ -15,15 +15,30 @@
  *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+/*
+ * IMF layout:
+ *
+ *   header (12 bytes): magic, flag at byte 7, width and height as 16 bit little endian
+ *   filter mode per row
+ *   RGB rows (width * 3 bytes, none for an unknown mode)
+ *   if flag > 0:
+ *     filter mode per row
+ *     alpha rows (width bytes, none for an unknown mode)
+ *
+ * The filters are PNG-like. Rows are unfiltered in place in the RGBA output
+ * (see imf_filters.h), using the previous output row as "up" -
+ * the first row has a zero row above it.
+ */
+
 #include "imf.h"
+#include "imf_filters.h"
+#include <log.h>
 
-#include <sstream>
 #include <vector>
-#include <cmath>
+#include <algorithm>
+#include <cstddef>
 #include <cassert>
-#include <iostream>
 
-using std::cout;
 using std::endl;
 
 namespace
@@ -31,231 +46,327 @@ namespace
 
   typedef unsigned char byte;
 
-  int paethPredictor(int a, int b, int c)
+  class SpanSource
+  {
+    const byte *m_pos = nullptr;
+    const byte *m_end = nullptr;
+
+  public:
+    SpanSource(const char *data, size_t size) :
+      m_pos(reinterpret_cast<const byte*>(data)),
+      m_end(m_pos + size)
+    {
+    }
+
+    // returns nullptr if less than size bytes are left
+    const byte *get(size_t size)
+    {
+      if (size_t(m_end - m_pos) < size)
+        return nullptr;
+      auto p = m_pos;
+      m_pos += size;
+      return p;
+    }
+  };
+
+
+  class FileSource
   {
-      a = a & 255;
-      b = b & 255;
-      c = c & 255;
-      int p = (a + b - c);
-      int pa = abs(p - a);
-      int pb = abs(p - b);
-      int pc = abs(p - c);
+    util::File &m_file;
+    std::vector<byte> m_buffer;
 
-      if ((pa <= pb) && (pa <= pc))
-          return a;
+  public:
+    FileSource(util::File &file) : m_file(file) {}
 
-      if (pb <= pc)
-          return b;
+    // the returned data is valid until the next call
+    const byte *get(size_t size)
+    {
+      m_buffer.resize(size);
+      if (size && m_file.read(reinterpret_cast<char*>(m_buffer.data()), size) != int(size))
+        return nullptr;
+      return m_buffer.data();
+    }
+  };
 
-      return c;
-  }
 
-  int Average(int a, int b)
+  bool parseHeader(const byte *header, int &flag, int &width, int &height)
   {
-    return (a+b)/2;
+    flag = header[7];
+    width = header[8] | (header[9] << 8);
+    height = header[10] | (header[11] << 8);
+    return width > 0 && height > 0;
   }
 
-}
-
 
-void getIMFInfo(util::File &file, int &w, int &h)
-{
-  file.skip(8);
+  void expandRGB(const byte *src, byte *dst, int width)
+  {
+    for (int x = 0; x < width; x++)
+    {
+      dst[x*4+0] = src[x*3+0];
+      dst[x*4+1] = src[x*3+1];
+      dst[x*4+2] = src[x*3+2];
+    }
+  }
 
-  char size_header[4];
-  file.read(size_header, sizeof(size_header));
 
-  w = size_header[0] | (size_header[1] << 8);
-  h = size_header[2] | (size_header[3] << 8);
+  // carry holds the last pixel of the previous row, repeated by unknown modes
+  void unfilterRowRGB(const il2ge::imf::RowFilters &filters, int mode,
+                      const byte *src, const byte *up, byte *dst,
+                      int width, byte carry[3])
+  {
+    if (src)
+      expandRGB(src, dst, width);
+
+    switch (mode)
+    {
+      case 0:
+        filters.rgb_none(dst, width);
+        break;
+      case 1:
+        filters.rgb_sub(dst, width);
+        break;
+      case 2:
+        filters.rgb_up(dst, up, width);
+        break;
+      case 3:
+        filters.rgb_average(dst, up, width);
+        break;
+      case 4:
+        filters.rgb_paeth(dst, up, width);
+        break;
+      default:
+        for (int x = 0; x < width; x++)
+        {
+          dst[x*4+0] = carry[0];
+          dst[x*4+1] = carry[1];
+          dst[x*4+2] = carry[2];
+          dst[x*4+3] = 255;
+        }
+    }
+
+    auto last = dst + (width - 1) * 4;
+    carry[0] = last[0];
+    carry[1] = last[1];
+    carry[2] = last[2];
+  }
 
-  file.rewind();
-}
 
+  // operates on the alpha channel of RGBA rows
+  void unfilterRowAlpha(const il2ge::imf::RowFilters &filters, int mode,
+                        const byte *src, const byte *up, byte *dst,
+                        int width, byte &carry)
+  {
+    switch (mode)
+    {
+      case 0:
+        filters.alpha_none(dst, src, width);
+        break;
+      case 1:
+        filters.alpha_sub(dst, src, width);
+        break;
+      case 2:
+        filters.alpha_up(dst, src, up, width);
+        break;
+      case 3:
+        filters.alpha_average(dst, src, up, width);
+        break;
+      case 4:
+        filters.alpha_paeth(dst, src, up, width);
+        break;
+      default:
+        for (int x = 0; x < width; x++)
+          dst[x*4+3] = carry;
+    }
+
+    carry = dst[(width - 1) * 4 + 3];
+  }
 
-void loadIMF(const std::vector<char> &src, std::vector<unsigned char> &out,
-             int &width, int &height, const std::string &name)
-{
-  std::istringstream br(std::string(src.data(), src.size()));
-  br.seekg(7);
 
-  int flag = br.get();
-  (void)flag;
+  bool isKnownMode(int mode)
+  {
+    return mode >= 0 && mode <= 4;
+  }
 
-  width = br.get() | (br.get() << 8);
-  height = br.get() | (br.get() << 8);
 
-  int imageSize = width * height * 4;
+  // dst must hold width * height * 4 bytes - with flip_y the first decoded row is the last in dst
+  template <class Source>
+  bool decode(Source &src, unsigned char *dst, size_t dst_size, bool flip_y,
+              const std::string &name, const il2ge::imf::RowFilters &filters)
+  {
+    int flag = 0;
+    int width = 0;
+    int height = 0;
+
+    auto header = src.get(IMF_HEADER_SIZE);
+    if (!header || !parseHeader(header, flag, width, height))
+    {
+      LOG_ERROR << "IMF: invalid header - " << name << endl;
+      return false;
+    }
+
+    const size_t row_size = size_t(width) * 4;
+
+    if (dst_size < row_size * height)
+    {
+      LOG_ERROR << "IMF: destination too small - " << name << endl;
+      return false;
+    }
+
+    const ptrdiff_t row_step = flip_y ? -ptrdiff_t(row_size) : ptrdiff_t(row_size);
+    auto first_row = flip_y ? dst + (height - 1) * row_size : dst;
+
+    // the source buffer may be reused by the rows
+    std::vector<byte> modes(height);
+    std::vector<byte> zero_row(row_size, 0);
+
+    auto read_modes = [&] ()
+    {
+      auto p = src.get(height);
+      if (!p)
+        return false;
+      std::copy(p, p + height, modes.begin());
+      for (int mode : modes)
+      {
+        if (!isKnownMode(mode))
+        {
+          LOG_WARNING << "IMF: unknown mode: " << mode << " - " << name << endl;
+          break;
+        }
+      }
+      return true;
+    };
 
-  out.resize(imageSize);
+    if (!read_modes())
+    {
+      LOG_ERROR << "IMF: unexpected end of file - " << name << endl;
+      return false;
+    }
 
-  std::vector<byte> data(imageSize);
+    byte carry[3] = { 0, 0, 0 };
 
-  std::vector<byte> mode(height);
-  br.read((char*) mode.data(), mode.size());
+    for (int y = 0; y < height; y++)
+    {
+      auto row = first_row + y * row_step;
+      auto up = y > 0 ? row - row_step : zero_row.data();
+      const byte *row_src = nullptr;
 
-  std::vector<byte> alpha(width * height);
+      if (isKnownMode(modes[y]))
+      {
+        row_src = src.get(size_t(width) * 3);
+        if (!row_src)
+        {
+          LOG_ERROR << "IMF: unexpected end of file - " << name << endl;
+          return false;
+        }
+      }
 
-  int pos = 0;
-  int pos2 = 0;
-  int prev = width * 4;
-  byte r = 0;
-  byte g = 0;
-  byte b = 0;
-  byte a = 0;
+      unfilterRowRGB(filters, modes[y], row_src, up, row, width, carry);
+    }
 
-  for (int y = 0; y < height; y++)
-  {
-      if (mode[y] < 4)
+    if (flag > 0)
+    {
+      if (!read_modes())
       {
-          r = g = b = 0;
+        LOG_ERROR << "IMF: unexpected end of file - " << name << endl;
+        return false;
       }
 
-      for (int x = 0; x < width; x++)
+      byte carry_alpha = carry[0];
+
+      for (int y = 0; y < height; y++)
       {
-          switch (mode[y])
+        auto row = first_row + y * row_step;
+        auto up = y > 0 ? row - row_step : zero_row.data();
+        const byte *row_src = nullptr;
+
+        if (isKnownMode(modes[y]))
+        {
+          row_src = src.get(width);
+          if (!row_src)
           {
-              // none
-              case 0:
-                  r = br.get();
-                  g = br.get();
-                  b = br.get();
-                  a = 255;
-                  break;
-
-              // sub
-              case 1:
-                  r += br.get();
-                  g += br.get();
-                  b += br.get();
-                  a = 255;
-                  break;
-
-              // up
-              case 2:
-                  b = data[pos - prev];
-                  g = data[pos - prev + 1];
-                  r = data[pos - prev + 2];
-
-                  r += br.get();
-                  g += br.get();
-                  b += br.get();
-                  a = 255;
-                  break;
-
-              // average
-              case 3:
-                  r = Average(r, data[pos - prev + 2]);
-                  g = Average(g, data[pos - prev + 1]);
-                  b = Average(b, data[pos - prev]);
-
-                  r += br.get();
-                  g += br.get();
-                  b += br.get();
-                  a = 255;
-                  break;
-
-              // paeth
-              case 4:
-                  if (x > 0)
-                  {
-                      r = (byte)paethPredictor(r, data[pos - prev + 2], data[pos - prev - 2]);
-                      g = (byte)paethPredictor(g, data[pos - prev + 1], data[pos - prev - 3]);
-                      b = (byte)paethPredictor(b, data[pos - prev], data[pos - prev - 4]);
-                  }
-                  else
-                  {
-                      r = (byte)paethPredictor(data[pos - prev + 2], data[pos - prev + 2], 0);//data[pos - prev - 2]);
-                      g = (byte)paethPredictor(data[pos - prev + 1], data[pos - prev + 1], 0);//data[pos - prev - 3]);
-                      b = (byte)paethPredictor(data[pos - prev], data[pos - prev], 0);//data[pos - prev - 4]);
-                  }
-
-                  r += br.get();
-                  g += br.get();
-                  b += br.get();
-                  a = 255;
-                  break;
-              default:
-                cout<<"IMF: unknown mode: "<<mode[y]<<" - "<<name<<endl;
-
+            LOG_ERROR << "IMF: unexpected end of file - " << name << endl;
+            return false;
           }
+        }
 
-          out[pos] = r;
-          out[pos+1] = g;
-          out[pos+2] = b;
-          out[pos+3] = a;
-
-          data[pos++] = b;
-          data[pos++] = g;
-          data[pos++] = r;
-          data[pos++] = a;
+        unfilterRowAlpha(filters, modes[y], row_src, up, row, width, carry_alpha);
       }
+    }
+
+    return true;
   }
 
-  if (flag > 0)
+}
+
+
+bool getIMFInfo(const char *data, size_t size, int &w, int &h)
+{
+  int flag = 0;
+  if (size < IMF_HEADER_SIZE)
+    return false;
+  return parseHeader(reinterpret_cast<const byte*>(data), flag, w, h);
+}
+
+
+bool getIMFInfo(util::File &file, int &w, int &h)
+{
+  char header[IMF_HEADER_SIZE];
+  auto read = file.read(header, sizeof(header));
+
+  file.rewind();
+
+  return read == sizeof(header) && getIMFInfo(header, sizeof(header), w, h);
+}
+
+
+bool decodeIMF(const char *data, size_t size, unsigned char *dst, size_t dst_size,
+               bool flip_y, const std::string &name)
+{
+  return decodeIMF(data, size, dst, dst_size, flip_y, name, il2ge::imf::getRowFilters());
+}
+
+
+bool decodeIMF(const char *data, size_t size, unsigned char *dst, size_t dst_size,
+               bool flip_y, const std::string &name, const il2ge::imf::RowFilters &filters)
+{
+  SpanSource src(data, size);
+  return decode(src, dst, dst_size, flip_y, name, filters);
+}
+
+
+bool loadIMF(const char *data, size_t size, std::vector<unsigned char> &out,
+             int &width, int &height, const std::string &name)
+{
+  if (!getIMFInfo(data, size, width, height))
   {
-      pos = 0;
-      br.read((char*) mode.data(), mode.size());
-      size_t pos_out = 3;
+    LOG_ERROR << "IMF: invalid header - " << name << endl;
+    return false;
+  }
+
+  out.resize(size_t(width) * height * 4);
+
+  return decodeIMF(data, size, out.data(), out.size(), false, name);
+}
 
-      for (int y = 0; y < height; y++)
-      {
-          if (mode[y] < 4)
-          {
-              r = 0;
-          }
-          for (int x = 0; x < width; x++)
-          {
-              switch (mode[y])
-              {
-                  case 0:
-                      r = br.get();
-                      break;
-                  case 1:
-                      r += br.get();
-                      break;
-                  case 2:
-                      r = alpha[pos - width];
-                      r += br.get();
-                      break;
-                  case 3:
-                      if (y == 0)
-                      {
-                          r = Average(r, 0);
-                      }
-                      else
-                      {
-                          r = Average(r, alpha[pos - width]);
-                      }
-                      r += br.get();
-                      break;
-                  case 4:
-                      {
-                          if (x > 0)
-                          {
-                              r = (byte)paethPredictor(r, alpha[pos - width], alpha[pos - width - 1]);
-                              r += br.get();
-                          }
-                          else
-                          {
-                              if (y > 1)
-                                  r = (byte)paethPredictor(alpha[pos - width], alpha[pos - width], alpha[pos - width - 1]);
-                              else
-                                  r = (byte)paethPredictor(alpha[pos - width], alpha[pos - width], 0);
-
-                              r += br.get();
-                          }
-                      }
-                      break;
-
-              }
-
-              alpha[pos++] = r;
-              assert(pos_out < out.size());
-              out[pos_out] = r;
-              pos_out+= 4;
-          }
-      }
 
+bool loadIMF(const std::vector<char> &src, std::vector<unsigned char> &out,
+             int &width, int &height, const std::string &name)
+{
+  return loadIMF(src.data(), src.size(), out, width, height, name);
+}
+
+
+bool loadIMF(util::File &file, std::vector<unsigned char> &out,
+             int &width, int &height, const std::string &name)
+{
+  if (!getIMFInfo(file, width, height))
+  {
+    LOG_ERROR << "IMF: invalid header - " << name << endl;
+    return false;
   }
 
+  out.resize(size_t(width) * height * 4);
+
+  FileSource src(file);
+  return decode(src, out.data(), out.size(), false, name, il2ge::imf::getRowFilters());
 }
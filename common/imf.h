@@ -22,9 +22,34 @@
 
 #include <vector>
 #include <string>
+#include <cstddef>
 
-void getIMFInfo(util::File &file, int &w, int &h);
-void loadIMF(const std::vector<char> &src, std::vector<unsigned char> &data,
+namespace il2ge::imf
+{
+  struct RowFilters;
+}
+
+constexpr size_t IMF_HEADER_SIZE = 12;
+
+// return false on a malformed or truncated image
+bool getIMFInfo(const char *data, size_t size, int &w, int &h);
+bool getIMFInfo(util::File &file, int &w, int &h);
+
+// Decodes to RGBA into dst, which must hold width * height * 4 bytes.
+// With flip_y the rows are stored bottom to top.
+bool decodeIMF(const char *data, size_t size, unsigned char *dst, size_t dst_size,
+               bool flip_y, const std::string &name);
+// same as above, with the given row filters (see imf_filters.h) instead of the fastest ones
+bool decodeIMF(const char *data, size_t size, unsigned char *dst, size_t dst_size,
+               bool flip_y, const std::string &name, const il2ge::imf::RowFilters &filters);
+
+// decode to RGBA
+bool loadIMF(const char *data, size_t size, std::vector<unsigned char> &out,
+             int &width, int &height, const std::string &name);
+bool loadIMF(const std::vector<char> &src, std::vector<unsigned char> &out,
+             int &width, int &height, const std::string &name);
+// reads row by row without buffering the whole file
+bool loadIMF(util::File &file, std::vector<unsigned char> &out,
              int &width, int &height, const std::string &name);
 
 #endif
@@ -0,0 +1,403 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "imf_filters.h"
+#include <log.h>
+
+#include <cstring>
+#include <cstdlib>
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define IL2GE_IMF_ENABLE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+
+namespace
+{
+
+
+typedef unsigned char byte;
+
+
+int paethPredictor(int a, int b, int c)
+{
+  int pa = abs(b - c);
+  int pb = abs(a - c);
+  int pc = abs(a + b - 2 * c);
+
+  if (pa <= pb && pa <= pc)
+    return a;
+  if (pb <= pc)
+    return b;
+  return c;
+}
+
+
+void setAlphaOpaque(byte *row, int width)
+{
+  for (int x = 0; x < width; x++)
+    row[x*4+3] = 255;
+}
+
+
+void rgbNone(byte *row, int width)
+{
+  setAlphaOpaque(row, width);
+}
+
+
+void rgbSub(byte *row, int width)
+{
+  for (int i = 4; i < width * 4; i++)
+    row[i] += row[i-4];
+  setAlphaOpaque(row, width);
+}
+
+
+void rgbUp(byte *row, const byte *up, int width)
+{
+  for (int i = 0; i < width * 4; i++)
+    row[i] += up[i];
+  setAlphaOpaque(row, width);
+}
+
+
+void rgbAverage(byte *row, const byte *up, int width)
+{
+  for (int i = 0; i < 4; i++)
+    row[i] += up[i] / 2;
+  for (int i = 4; i < width * 4; i++)
+    row[i] += (row[i-4] + up[i]) / 2;
+  setAlphaOpaque(row, width);
+}
+
+
+// the first pixel predicts from up only
+void rgbPaeth(byte *row, const byte *up, int width)
+{
+  for (int i = 0; i < 4; i++)
+    row[i] += up[i];
+  for (int i = 4; i < width * 4; i++)
+    row[i] += paethPredictor(row[i-4], up[i], up[i-4]);
+  setAlphaOpaque(row, width);
+}
+
+
+void alphaNone(byte *row, const byte *src, int width)
+{
+  for (int x = 0; x < width; x++)
+    row[x*4+3] = src[x];
+}
+
+
+void alphaSub(byte *row, const byte *src, int width)
+{
+  byte a = 0;
+  for (int x = 0; x < width; x++)
+    row[x*4+3] = a += src[x];
+}
+
+
+void alphaUp(byte *row, const byte *src, const byte *up, int width)
+{
+  for (int x = 0; x < width; x++)
+    row[x*4+3] = up[x*4+3] + src[x];
+}
+
+
+void alphaAverage(byte *row, const byte *src, const byte *up, int width)
+{
+  byte a = 0;
+  for (int x = 0; x < width; x++)
+    row[x*4+3] = a = (a + up[x*4+3]) / 2 + src[x];
+}
+
+
+void alphaPaeth(byte *row, const byte *src, const byte *up, int width)
+{
+  row[3] = up[3] + src[0];
+  for (int x = 1; x < width; x++)
+    row[x*4+3] = paethPredictor(row[(x-1)*4+3], up[x*4+3], up[(x-1)*4+3]) + src[x];
+}
+
+
+#if IL2GE_IMF_ENABLE_SSE2
+
+/*
+ * SSE2 kernels - compiled for SSE2 regardless of the global compiler flags
+ * and only used if the CPU supports it.
+ * The serial filters (sub, average, paeth) process one pixel per step.
+ */
+
+#define TARGET_SSE2 __attribute__((target("sse2")))
+
+
+TARGET_SSE2 inline __m128i load4(const byte *p)
+{
+  int value;
+  memcpy(&value, p, 4);
+  return _mm_cvtsi32_si128(value);
+}
+
+
+TARGET_SSE2 inline void store4(byte *p, __m128i v)
+{
+  int value = _mm_cvtsi128_si32(v);
+  memcpy(p, &value, 4);
+}
+
+
+TARGET_SSE2 inline __m128i alphaMask()
+{
+  return _mm_set1_epi32(int(0xff000000));
+}
+
+
+TARGET_SSE2 inline __m128i abs16(__m128i v)
+{
+  return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+
+TARGET_SSE2 inline __m128i select(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+
+TARGET_SSE2 void rgbNoneSSE2(byte *row, int width)
+{
+  const __m128i alpha = alphaMask();
+  int i = 0;
+  for (; i + 16 <= width * 4; i += 16)
+  {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(row + i), _mm_or_si128(v, alpha));
+  }
+  for (; i < width * 4; i += 4)
+    store4(row + i, _mm_or_si128(load4(row + i), alpha));
+}
+
+
+TARGET_SSE2 void rgbSubSSE2(byte *row, int width)
+{
+  const __m128i alpha = alphaMask();
+  __m128i a = _mm_setzero_si128();
+  for (int i = 0; i < width * 4; i += 4)
+  {
+    a = _mm_add_epi8(load4(row + i), a);
+    store4(row + i, _mm_or_si128(a, alpha));
+  }
+}
+
+
+TARGET_SSE2 void rgbUpSSE2(byte *row, const byte *up, int width)
+{
+  const __m128i alpha = alphaMask();
+  int i = 0;
+  for (; i + 16 <= width * 4; i += 16)
+  {
+    auto v = _mm_add_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)),
+                          _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + i)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(row + i), _mm_or_si128(v, alpha));
+  }
+  for (; i < width * 4; i += 4)
+    store4(row + i, _mm_or_si128(_mm_add_epi8(load4(row + i), load4(up + i)), alpha));
+}
+
+
+TARGET_SSE2 void rgbAverageSSE2(byte *row, const byte *up, int width)
+{
+  const __m128i alpha = alphaMask();
+  const __m128i one = _mm_set1_epi8(1);
+  __m128i a = _mm_setzero_si128();
+  for (int i = 0; i < width * 4; i += 4)
+  {
+    auto b = load4(up + i);
+    // pavgb rounds up
+    auto avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+    a = _mm_add_epi8(load4(row + i), avg);
+    store4(row + i, _mm_or_si128(a, alpha));
+  }
+}
+
+
+// with a = c = 0 the first pixel predicts from up
+TARGET_SSE2 void rgbPaethSSE2(byte *row, const byte *up, int width)
+{
+  const __m128i alpha = alphaMask();
+  const __m128i zero = _mm_setzero_si128();
+  __m128i a = zero;
+  __m128i c = zero;
+  for (int i = 0; i < width * 4; i += 4)
+  {
+    auto b = _mm_unpacklo_epi8(load4(up + i), zero);
+
+    auto pa_signed = _mm_sub_epi16(b, c);
+    auto pb_signed = _mm_sub_epi16(a, c);
+    auto pa = abs16(pa_signed);
+    auto pb = abs16(pb_signed);
+    auto pc = abs16(_mm_add_epi16(pa_signed, pb_signed));
+
+    auto smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+
+    // ties favor a over b over c
+    auto nearest = select(_mm_cmpeq_epi16(smallest, pc), c, b);
+    nearest = select(_mm_cmpeq_epi16(smallest, pb), b, nearest);
+    nearest = select(_mm_cmpeq_epi16(smallest, pa), a, nearest);
+
+    auto value = _mm_add_epi8(load4(row + i), _mm_packus_epi16(nearest, zero));
+    store4(row + i, _mm_or_si128(value, alpha));
+
+    a = _mm_unpacklo_epi8(value, zero);
+    c = b;
+  }
+}
+
+
+// 4 pixels per step - up may be nullptr
+TARGET_SSE2 inline void insertAlphaSSE2(byte *row, const byte *src, const byte *up, int width)
+{
+  const __m128i alpha = alphaMask();
+  int x = 0;
+  for (; x + 4 <= width; x += 4)
+  {
+    auto s = load4(src + x);
+    s = _mm_unpacklo_epi8(s, s);
+    s = _mm_unpacklo_epi16(s, s);
+    s = _mm_and_si128(s, alpha);
+
+    if (up)
+    {
+      auto u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + x * 4));
+      s = _mm_add_epi8(s, _mm_and_si128(u, alpha));
+    }
+
+    auto p = reinterpret_cast<__m128i*>(row + x * 4);
+    auto rgb = _mm_andnot_si128(alpha, _mm_loadu_si128(p));
+    _mm_storeu_si128(p, _mm_or_si128(rgb, s));
+  }
+
+  for (; x < width; x++)
+    row[x*4+3] = up ? byte(up[x*4+3] + src[x]) : src[x];
+}
+
+
+TARGET_SSE2 void alphaNoneSSE2(byte *row, const byte *src, int width)
+{
+  insertAlphaSSE2(row, src, nullptr, width);
+}
+
+
+TARGET_SSE2 void alphaUpSSE2(byte *row, const byte *src, const byte *up, int width)
+{
+  insertAlphaSSE2(row, src, up, width);
+}
+
+
+#undef TARGET_SSE2
+
+
+bool isSSE2Supported()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse2");
+}
+
+
+il2ge::imf::RowFilters createSSE2RowFilters()
+{
+  auto filters = il2ge::imf::getScalarRowFilters();
+
+  filters.rgb_none = rgbNoneSSE2;
+  filters.rgb_sub = rgbSubSSE2;
+  filters.rgb_up = rgbUpSSE2;
+  filters.rgb_average = rgbAverageSSE2;
+  filters.rgb_paeth = rgbPaethSSE2;
+  filters.alpha_none = alphaNoneSSE2;
+  filters.alpha_up = alphaUpSSE2;
+
+  return filters;
+}
+
+#endif
+
+
+const il2ge::imf::RowFilters &selectRowFilters()
+{
+  auto sse2 = il2ge::imf::getSSE2RowFilters();
+  if (sse2)
+  {
+    LOG_INFO << "IMF: using SSE2 row filters" << endl;
+    return *sse2;
+  }
+
+  return il2ge::imf::getScalarRowFilters();
+}
+
+
+} // namespace
+
+
+namespace il2ge::imf
+{
+
+
+const RowFilters &getScalarRowFilters()
+{
+  static const RowFilters filters =
+  {
+    rgbNone,
+    rgbSub,
+    rgbUp,
+    rgbAverage,
+    rgbPaeth,
+    alphaNone,
+    alphaSub,
+    alphaUp,
+    alphaAverage,
+    alphaPaeth,
+  };
+
+  return filters;
+}
+
+
+const RowFilters *getSSE2RowFilters()
+{
+#if IL2GE_IMF_ENABLE_SSE2
+  static const RowFilters filters = createSSE2RowFilters();
+  static const bool is_supported = isSSE2Supported();
+  return is_supported ? &filters : nullptr;
+#else
+  return nullptr;
+#endif
+}
+
+
+const RowFilters &getRowFilters()
+{
+  static const RowFilters &filters = selectRowFilters();
+  return filters;
+}
+
+
+} // namespace il2ge::imf
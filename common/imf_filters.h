@@ -0,0 +1,65 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IL2GE_IMF_FILTERS_H
+#define IL2GE_IMF_FILTERS_H
+
+namespace il2ge::imf
+{
+
+
+/*
+ * Row unfilter kernels for IMF images.
+ * All rows are RGBA with width pixels, "up" is the previous output row.
+ *
+ * The RGB kernels work in place on a row holding the filtered RGB values
+ * (alpha is ignored) and set alpha to 255.
+ * The alpha kernels take the filtered alpha values from src and only modify alpha.
+ */
+struct RowFilters
+{
+  void (*rgb_none)(unsigned char *row, int width);
+  void (*rgb_sub)(unsigned char *row, int width);
+  void (*rgb_up)(unsigned char *row, const unsigned char *up, int width);
+  void (*rgb_average)(unsigned char *row, const unsigned char *up, int width);
+  void (*rgb_paeth)(unsigned char *row, const unsigned char *up, int width);
+
+  void (*alpha_none)(unsigned char *row, const unsigned char *src, int width);
+  void (*alpha_sub)(unsigned char *row, const unsigned char *src, int width);
+  void (*alpha_up)(unsigned char *row, const unsigned char *src,
+                   const unsigned char *up, int width);
+  void (*alpha_average)(unsigned char *row, const unsigned char *src,
+                        const unsigned char *up, int width);
+  void (*alpha_paeth)(unsigned char *row, const unsigned char *src,
+                      const unsigned char *up, int width);
+};
+
+
+// portable implementation
+const RowFilters &getScalarRowFilters();
+
+// nullptr if the build or the CPU doesn't support SSE2
+const RowFilters *getSSE2RowFilters();
+
+// the fastest implementation supported by the CPU
+const RowFilters &getRowFilters();
+
+
+}
+
+#endif
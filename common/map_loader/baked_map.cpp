@@ -0,0 +1,405 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Baked map cache file layout (all values little endian, as written by the x86 host):
+ *
+ *   FileHeader
+ *   key (FileHeader::key_size bytes, padded to ALIGNMENT)
+ *   Entry[FileHeader::num_entries]
+ *   entry data, each starting at an ALIGNMENT boundary
+ *
+ * An entry holds num_layers images of equal size stored back to back.
+ * Its size must be exactly w * h * pixel_size * num_layers.
+ */
+
+#include <il2ge/map_loader.h>
+#include <render_util/image.h>
+#include <log.h>
+
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cassert>
+#include <stdexcept>
+
+using namespace std;
+using namespace render_util;
+using namespace il2ge::map_loader;
+
+
+namespace
+{
+
+
+constexpr char MAGIC[8] = { 'I', 'L', '2', 'G', 'E', 'M', 'A', 'P' };
+constexpr uint32_t VERSION = 2;
+constexpr size_t ALIGNMENT = 16;
+constexpr int32_t MAX_IMAGE_SIZE = 0x10000;
+constexpr uint32_t MAX_PIXEL_SIZE = 16;
+
+
+struct FileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t num_entries;
+  uint32_t key_size;
+  uint32_t reserved;
+};
+
+
+struct Entry
+{
+  char name[32];
+  int32_t w;
+  int32_t h;
+  uint32_t num_layers;
+  uint32_t pixel_size;
+  uint64_t offset;
+  uint64_t size;
+};
+
+
+size_t align(size_t offset)
+{
+  return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+
+template <class T>
+uint32_t getPixelSize()
+{
+  return T(glm::ivec2(1)).getDataSize();
+}
+
+
+// checked before anything is allocated for the entry
+bool isValid(const Entry &entry, uint64_t file_size)
+{
+  if (entry.w < 1 || entry.h < 1 || entry.w > MAX_IMAGE_SIZE || entry.h > MAX_IMAGE_SIZE)
+    return false;
+
+  if (!entry.num_layers || !entry.pixel_size || entry.pixel_size > MAX_PIXEL_SIZE)
+    return false;
+
+  uint64_t layer_size = uint64_t(entry.w) * entry.h * entry.pixel_size;
+
+  if (entry.size % layer_size != 0 || entry.size / layer_size != entry.num_layers)
+    return false;
+
+  return entry.offset <= file_size && entry.size <= file_size - entry.offset;
+}
+
+
+class Writer
+{
+  struct Blob
+  {
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+  };
+
+  vector<Entry> m_entries;
+  vector<vector<Blob>> m_blobs;
+
+public:
+  template <class T>
+  void add(const char *name, const vector<shared_ptr<const T>> &images)
+  {
+    if (images.empty())
+      return;
+
+    Entry entry {};
+    assert(strlen(name) < sizeof(entry.name));
+    strncpy(entry.name, name, sizeof(entry.name) - 1);
+    entry.w = images.front()->w();
+    entry.h = images.front()->h();
+    entry.num_layers = images.size();
+    entry.pixel_size = getPixelSize<T>();
+
+    vector<Blob> blobs;
+
+    for (auto &image : images)
+    {
+      assert(image);
+      assert(image->getSize() == images.front()->getSize());
+      blobs.push_back({ image->getData(), image->getDataSize() });
+      entry.size += image->getDataSize();
+    }
+
+    m_entries.push_back(entry);
+    m_blobs.push_back(move(blobs));
+  }
+
+  template <class T>
+  void add(const char *name, shared_ptr<const T> image)
+  {
+    if (image)
+      add<T>(name, vector<shared_ptr<const T>> { image });
+  }
+
+  bool write(const string &path, const string &key)
+  {
+    FileHeader header {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.num_entries = m_entries.size();
+    header.key_size = key.size();
+
+    size_t offset = align(align(sizeof(header) + key.size()) + m_entries.size() * sizeof(Entry));
+    for (auto &entry : m_entries)
+    {
+      entry.offset = offset;
+      offset = align(offset + entry.size);
+    }
+
+    auto tmp_path = path + ".tmp";
+
+    {
+      ofstream out(tmp_path, ios_base::binary | ios_base::trunc);
+
+      auto pad = [&out] ()
+      {
+        static const char zeros[ALIGNMENT] {};
+        size_t pos = out.tellp();
+        out.write(zeros, align(pos) - pos);
+      };
+
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      out.write(key.data(), key.size());
+      pad();
+      out.write(reinterpret_cast<const char*>(m_entries.data()), m_entries.size() * sizeof(Entry));
+
+      for (size_t i = 0; i < m_entries.size(); i++)
+      {
+        pad();
+        assert(size_t(out.tellp()) == m_entries[i].offset);
+        for (auto &blob : m_blobs[i])
+          out.write(reinterpret_cast<const char*>(blob.data), blob.size);
+      }
+
+      if (!out.good())
+      {
+        LOG_ERROR << "Failed to write " << tmp_path << endl;
+        return false;
+      }
+    }
+
+    remove(path.c_str());
+    if (rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+      LOG_ERROR << "Failed to rename " << tmp_path << " -> " << path << endl;
+      return false;
+    }
+
+    return true;
+  }
+};
+
+
+class Reader
+{
+  ifstream m_in;
+  size_t m_size = 0;
+  vector<Entry> m_entries;
+
+  const Entry *find(const char *name)
+  {
+    for (auto &entry : m_entries)
+    {
+      if (strncmp(entry.name, name, sizeof(Entry::name)) == 0)
+        return &entry;
+    }
+    return nullptr;
+  }
+
+  bool read(size_t offset, void *out, size_t size)
+  {
+    m_in.seekg(offset);
+    m_in.read(reinterpret_cast<char*>(out), size);
+    return m_in.good();
+  }
+
+public:
+  Reader(const string &path) : m_in(path, ios_base::binary)
+  {
+    if (!m_in.is_open())
+      throw std::runtime_error("Failed to open " + path);
+
+    m_in.seekg(0, ios_base::end);
+    m_size = m_in.tellg();
+  }
+
+  bool open(const string &key)
+  {
+    FileHeader header {};
+
+    if (m_size < sizeof(FileHeader) || !read(0, &header, sizeof(header)))
+      return false;
+
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION)
+      return false;
+
+    if (header.key_size != key.size() || m_size < sizeof(FileHeader) + key.size())
+      return false;
+
+    string file_key(key.size(), '\0');
+    if (!read(sizeof(FileHeader), &file_key[0], file_key.size()) || file_key != key)
+      return false;
+
+    auto entries_offset = align(sizeof(FileHeader) + key.size());
+    if (m_size < entries_offset + uint64_t(header.num_entries) * sizeof(Entry))
+      return false;
+
+    m_entries.resize(header.num_entries);
+    if (!read(entries_offset, m_entries.data(), m_entries.size() * sizeof(Entry)))
+      return false;
+
+    for (auto &entry : m_entries)
+    {
+      if (!isValid(entry, m_size))
+      {
+        LOG_WARNING << "Baked map: invalid entry " << string(entry.name, strnlen(entry.name, sizeof(entry.name)))
+                    << endl;
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // reads straight into the images - the file is never held in memory as a whole
+  template <class T>
+  bool get(const char *name, vector<shared_ptr<const T>> &images)
+  {
+    auto entry = find(name);
+    if (!entry)
+      return false;
+
+    // the entry's size was validated in open()
+    if (entry->pixel_size != getPixelSize<T>())
+    {
+      LOG_ERROR << "Baked map: " << name << " has the wrong pixel format" << endl;
+      return false;
+    }
+
+    size_t layer_size = entry->size / entry->num_layers;
+
+    for (size_t i = 0; i < entry->num_layers; i++)
+    {
+      auto image = make_shared<T>(glm::ivec2(entry->w, entry->h));
+      assert(image->getDataSize() == layer_size);
+      if (!read(entry->offset + i * layer_size, image->getData(), layer_size))
+      {
+        LOG_ERROR << "Baked map: failed to read " << name << endl;
+        return false;
+      }
+      images.push_back(image);
+    }
+
+    return true;
+  }
+
+  template <class T>
+  bool get(const char *name, shared_ptr<const T> &image)
+  {
+    vector<shared_ptr<const T>> images;
+    if (get<T>(name, images) && images.size() == 1)
+    {
+      image = images.front();
+      return true;
+    }
+    return false;
+  }
+};
+
+
+} // namespace
+
+
+namespace il2ge::map_loader
+{
+
+
+bool loadBakedMap(const string &path, const string &key, BakedMap &map)
+{
+  try
+  {
+    Reader reader(path);
+
+    if (!reader.open(key))
+    {
+      LOG_INFO << "Baked map " << path << " is outdated." << endl;
+      return false;
+    }
+
+    BakedMap baked;
+
+    bool success =
+      reader.get<ImageGreyScale>("pixel_map_h", baked.pixel_map_h) &&
+      reader.get<ElevationMap>("elevation_map", baked.elevation_map) &&
+      reader.get<ImageGreyScale>("type_map", baked.type_map) &&
+      reader.get<ImageGreyScale>("land_type_map", baked.land_type_map) &&
+      reader.get<ImageGreyScale>("water_type_map", baked.water_type_map) &&
+      reader.get<ImageGreyScale>("forest_map", baked.forest_map) &&
+      reader.get<TerrainBase::MaterialMap>("material_map", baked.material_map) &&
+      reader.get<ImageGreyScale>("water_map_chunks", baked.water_map_chunks) &&
+      reader.get<Image<unsigned int>>("water_map_table", baked.water_map_table) &&
+      reader.get<ImageRGBA>("far_texture", baked.far_texture);
+
+    if (!success)
+    {
+      LOG_WARNING << "Baked map " << path << " is incomplete." << endl;
+      return false;
+    }
+
+    map = move(baked);
+    return true;
+  }
+  catch (std::exception &e)
+  {
+    LOG_INFO << e.what() << endl;
+    return false;
+  }
+}
+
+
+bool saveBakedMap(const string &path, const string &key, const BakedMap &map)
+{
+  Writer writer;
+
+  writer.add<ImageGreyScale>("pixel_map_h", map.pixel_map_h);
+  writer.add<ElevationMap>("elevation_map", map.elevation_map);
+  writer.add<ImageGreyScale>("type_map", map.type_map);
+  writer.add<ImageGreyScale>("land_type_map", map.land_type_map);
+  writer.add<ImageGreyScale>("water_type_map", map.water_type_map);
+  writer.add<ImageGreyScale>("forest_map", map.forest_map);
+  writer.add<TerrainBase::MaterialMap>("material_map", map.material_map);
+  writer.add<ImageGreyScale>("water_map_chunks", map.water_map_chunks);
+  writer.add<Image<unsigned int>>("water_map_table", map.water_map_table);
+  writer.add<ImageRGBA>("far_texture", map.far_texture);
+
+  LOG_INFO << "Writing baked map " << path << " ..." << endl;
+
+  return writer.write(path, key);
+}
+
+
+} // namespace il2ge::map_loader
@@ -35,7 +35,55 @@ namespace
 {
 
 
-vector<ImageRGBA::ConstPtr> getForestLayers(il2ge::RessourceLoader *loader)
+// dst = mix(dst, src, src.alpha) with dst.alpha = 1.
+// Goes through the same pixelToVector() / mix() / vectorToPixel() as a per pixel getPixel() loop,
+// so the result is bit exact - it only saves the accessors and the modulo per pixel.
+void blendRow(unsigned char *dst, const unsigned char *src, int num_pixels)
+{
+  for (int i = 0; i < num_pixels * 4; i += 4)
+  {
+    ImageRGBA::PixelType dst_pixel;
+    ImageRGBA::PixelType src_pixel;
+    for (int c = 0; c < 4; c++)
+    {
+      dst_pixel[c] = dst[i + c];
+      src_pixel[c] = src[i + c];
+    }
+
+    vec4 combined = pixelToVector(dst_pixel);
+    vec4 src_color = pixelToVector(src_pixel);
+
+    vec4 new_combined = mix(combined, src_color, src_color.w);
+    new_combined.w = 1;
+
+    auto new_pixel = vectorToPixel(new_combined);
+    for (int c = 0; c < 4; c++)
+      dst[i + c] = new_pixel[c];
+  }
+}
+
+
+// Blends src into dst, with src shifted by offset and wrapped around.
+void blend(ImageRGBA &dst, const ImageRGBA &src, ivec2 offset)
+{
+  assert(dst.getSize() == src.getSize());
+
+  const int w = dst.w();
+  const int h = dst.h();
+  const int shift_x = offset.x % w;
+
+  for (int y = 0; y < h; y++)
+  {
+    auto dst_row = reinterpret_cast<unsigned char*>(dst.getData()) + y * w * 4;
+    auto src_row = reinterpret_cast<const unsigned char*>(src.getData()) + ((y + offset.y) % h) * w * 4;
+
+    blendRow(dst_row, src_row + shift_x * 4, w - shift_x);
+    blendRow(dst_row + (w - shift_x) * 4, src_row, shift_x);
+  }
+}
+
+
+vector<ImageRGBA::ConstPtr> getForestLayers(TextureMemo &textures_memo)
 {
   vector<ImageRGBA::ConstPtr> textures;
 
@@ -45,7 +93,7 @@ vector<ImageRGBA::ConstPtr> getForestLayers(il2ge::RessourceLoader *loader)
 
     auto name = string("Wood") + to_string(i);
 
-    ImageRGBA::Ptr texture = getTexture("WOOD", name.c_str(), "", loader);
+    auto texture = textures_memo.get("WOOD", name.c_str());
     if (!texture)
       continue;
 
@@ -56,7 +104,7 @@ vector<ImageRGBA::ConstPtr> getForestLayers(il2ge::RessourceLoader *loader)
 }
 
 
-ImageRGBA::Ptr createForestFarTexture(il2ge::RessourceLoader *loader)
+ImageRGBA::Ptr createForestFarTexture(TextureMemo &textures)
 {
   ImageRGBA::Ptr combined_texture;
 
@@ -77,7 +125,7 @@ ImageRGBA::Ptr createForestFarTexture(il2ge::RessourceLoader *loader)
 
       auto name = string("Wood") + to_string(i);
 
-      ImageRGBA::Ptr texture = getTexture("WOOD", name.c_str(), "", loader);
+      auto texture = textures.get("WOOD", name.c_str());
       if (!texture)
         continue;
 
@@ -92,31 +140,15 @@ ImageRGBA::Ptr createForestFarTexture(il2ge::RessourceLoader *loader)
       else
       {
         assert(combined_texture->size() == texture->size());
-        for (int y = 0; y < combined_texture->h(); y++)
-        {
-          for (int x = 0; x < combined_texture->w(); x++)
-          {
-            vec4 combined = pixelToVector(combined_texture->getPixel(x, y));
-
-            int x_src = (x + (i * offset_x)) % texture->w();
-            int y_src = (y + (i * offset_y)) % texture->h();
-
-            vec4 src = pixelToVector(texture->getPixel(x_src, y_src));
-
-            vec4 new_combined = mix(combined, src, src.w);
-            new_combined.w = glm::max(combined.w, src.w);
-            new_combined.w = 1;
-
-            combined_texture->setPixel(x, y, vectorToPixel(new_combined));
-          }
-        }
+        blend(*combined_texture, *texture, ivec2(i * offset_x, i * offset_y));
       }
     }
   }
 
+  assert(combined_texture);
   combined_texture = downSample(combined_texture, 2);
 
-  dump<ImageRGBA>(combined_texture, "WOOD_far.tga", loader->getDumpDir());
+  dump<ImageRGBA>(combined_texture, "WOOD_far.tga", textures.getLoader()->getDumpDir());
 
 //   vec4 color = pixelToVector(image::getAverageColor(combined_texture.get()));
 
@@ -127,20 +159,6 @@ ImageRGBA::Ptr createForestFarTexture(il2ge::RessourceLoader *loader)
 }
 
 
-ImageRGBA::Ptr createForestFarTexture_alt(il2ge::RessourceLoader *loader)
-{
-  ImageRGBA::Ptr texture = getTexture("WOOD", "Wood1", "", loader);
-  assert(texture);
-
-  texture->forEach(3, [] (unsigned char &alpha)
-  {
-    alpha = 255;
-  });
-
-  return texture;
-}
-
-
 bool isForest(const ivec2 &pos, ImageGreyScale::ConstPtr type_map)
 {
   return map_loader::isForest(type_map->get(pos) & 0x1F);
@@ -171,22 +189,15 @@ ImageGreyScale::Ptr createForestMap(ImageGreyScale::ConstPtr type_map)
 }
 
 
-void createForestTextures(ImageGreyScale::ConstPtr type_map,
-                          MapTextures *map_textures,
-                          il2ge::RessourceLoader *loader)
+ImageRGBA::Ptr loadForestFarTexture(TextureMemo &textures)
+{
+  return createForestFarTexture(textures);
+}
+
+
+vector<ImageRGBA::ConstPtr> loadForestLayers(TextureMemo &textures)
 {
-  LOG_DEBUG<<"loading forest texture ..."<<endl;
-  auto forest_map = createForestMap(type_map);
-  assert(forest_map);
-  map_textures->setForestMap(forest_map);
-
-//   map_textures->setTexture(TEXUNIT_FOREST_FAR, createForestFarTexture(loader));
-  map_textures->setTexture(TEXUNIT_FOREST_FAR, createForestFarTexture_alt(loader));
-
-  vector<ImageRGBA::ConstPtr> forest_layers = getForestLayers(loader);
-  assert(!forest_layers.empty());
-  map_textures->setForestLayers(forest_layers);
-  LOG_DEBUG<<"loading forest texture done."<<endl;
+  return getForestLayers(textures);
 }
 
 
@@ -23,21 +23,15 @@
 
 #include <vector>
 
-namespace render_util
-{
-  class MapTextures;
-}
-
-namespace il2ge
+namespace il2ge::map_loader
 {
-  class RessourceLoader;
+  class TextureMemo;
 }
 
 namespace il2ge::map_loader
 {
-  void createForestTextures(render_util::ImageGreyScale::ConstPtr type_map,
-                            render_util::MapTextures *map_textures,
-                            il2ge::RessourceLoader *loader);
+  render_util::ImageRGBA::Ptr loadForestFarTexture(TextureMemo&);
+  std::vector<render_util::ImageRGBA::ConstPtr> loadForestLayers(TextureMemo&);
 }
 
 #endif
@@ -33,6 +33,8 @@
 #include <il2ge/map_loader.h>
 #include <il2ge/ressource_loader.h>
 #include <il2ge/image_loader.h>
+#include <il2ge/thread_pool.h>
+#include <il2ge/memory_stats.h>
 #include <log.h>
 
 #include <FastNoise.h>
@@ -47,6 +49,7 @@
 #include <cstring>
 #include <cmath>
 #include <memory>
+#include <stdexcept>
 #include <glm/glm.hpp>
 
 #include <GL/gl.h>
@@ -69,6 +72,13 @@ constexpr auto RANDOM_CIRRUS_TEXTURE_DIR = "il2ge_random_cirrus_textures";
 
 const vec3 default_water_color = vec3(45,51,40) / vec3(255);
 
+void reportProgress(const ProgressFunc &progress, float fraction, const string &description)
+{
+  if (progress)
+    progress(fraction, description);
+}
+
+
 void dumpFile(string name, const char *data, size_t data_size, const string &dump_dir)
 {
   if (!isDumpEnabled() || dump_dir.empty())
@@ -124,6 +134,64 @@ float elevation_table[256] =
 };
 
 
+constexpr unsigned NUM_CHUNK_TYPES = 3;
+
+
+// Everything the derived maps need to know about a field, indexed by the 5 bit field index.
+struct FieldClassification
+{
+  unsigned char land_type[NUM_FIELDS];
+  unsigned char water_type[NUM_FIELDS];
+  unsigned char forest[NUM_FIELDS];
+  bool is_forest[NUM_FIELDS];
+  // indexed by water_map::ChunkType
+  TerrainBase::MaterialMap::ComponentType material[NUM_CHUNK_TYPES][NUM_FIELDS];
+
+  FieldClassification()
+  {
+    static_assert(water_map::CHUNK_EMPTY < NUM_CHUNK_TYPES);
+    static_assert(water_map::CHUNK_FULL < NUM_CHUNK_TYPES);
+    static_assert(water_map::CHUNK_MIXED < NUM_CHUNK_TYPES);
+
+    for (unsigned index = 0; index < NUM_FIELDS; index++)
+    {
+      auto name = field_names[index];
+
+      is_forest[index] =
+        strcmp(name, "Wood0") == 0 ||
+        strcmp(name, "Wood1") == 0 ||
+        strcmp(name, "Wood2") == 0 ||
+        strcmp(name, "Wood3") == 0;
+
+      land_type[index] = index;
+      if (strcmp(name, "Wood1") == 0 || strcmp(name, "Wood3") == 0)
+        land_type[index] = index - 1;
+
+      int water_type_ = glm::clamp((int)index - 28, -1, 31) + 1;
+      assert(water_type_ >= 0);
+      assert(water_type_ <= 4);
+      water_type[index] = water_type_;
+
+      forest[index] = is_forest[index] ? 255 : 0;
+
+      unsigned int land_material = is_forest[index] ?
+        TerrainBase::MaterialID::FOREST : TerrainBase::MaterialID::LAND;
+
+      material[water_map::CHUNK_EMPTY][index] = TerrainBase::MaterialID::WATER;
+      material[water_map::CHUNK_FULL][index] = land_material;
+      material[water_map::CHUNK_MIXED][index] = land_material | TerrainBase::MaterialID::WATER;
+    }
+  }
+};
+
+
+const FieldClassification &getFieldClassification()
+{
+  static const FieldClassification classification;
+  return classification;
+}
+
+
 auto &getRandomNumberGenerator()
 {
   static std::mt19937 gen(time(nullptr));
@@ -154,274 +222,561 @@ void createWaterMap
 
   {
     ivec2 table_size = (type_map_size * ivec2(4)) / ivec2(chunk_size);
-    size_t data_size = table_size.x * table_size.y;
 
-    istringstream file;
+    vector<char> data;
+    if (!loader->readFile("MAP", "ColorMap", "map_c.tga", "_table", data))
+      throw std::runtime_error("Failed to read water map table");
 
-    {
-      vector<char> data;
-      if (!loader->readFile("MAP", "ColorMap", "map_c.tga", "_table", data))
-      {
-        assert(0);
-      }
-      dumpFile("MAP_ColorMap.tga_table", data.data(), data.size(), loader->getDumpDir());
+    dumpFile("MAP_ColorMap.tga_table", data.data(), data.size(), loader->getDumpDir());
 
-      file.str(string(data.data(), data.size()));
-    }
+    Image<unsigned int>::Ptr table;
+    string error;
+    if (!il2ge::parseWaterMapTable(data.data(), data.size(), table_size,
+                                   water_map.chunks.size(), table, error))
+      throw std::runtime_error("Malformed water map table: " + error);
 
-    vector<unsigned int> data;
+    water_map.table = table;
 
-    assert(file.good());
+    il2ge::convertWaterMap(water_map, map, small_water_map);
+  }
+}
 
-    file.seekg(16);
-    assert(file.good());
 
-    while (data.size() < data_size)
-    {
-      assert(file.good());
-      unsigned int value = file.get() << 24 | file.get() << 16 | file.get() << 8 | file.get();
-      data.push_back(value);
-    }
+struct FieldTextureFiles
+{
+  vector<char> texture;
+  vector<char> normal_map;
+  bool has_texture = false;
+  bool has_normal_map = false;
+  float scale = 1.0;
+};
+
 
-    assert(data.size() == data_size);
+void readFieldTextureFiles(const char *field_name,
+                           FieldTextureFiles &files,
+                           il2ge::RessourceLoader *loader,
+                           bool enable_normal_maps)
+{
+  string dump_name = string("FIELDS_") + field_name;
 
-    water_map.table = std::make_shared<Image<unsigned int>>(table_size, data);
-    water_map.table = image::flipY(water_map.table);
+  files.has_texture = loader->readTextureFile("FIELDS", field_name, "", files.texture,
+                                              false, true, &files.scale);
+  if (files.has_texture)
+    dump(to_string(files.scale), dump_name + "_scale", loader->getDumpDir());
 
-    il2ge::convertWaterMap(water_map, map, small_water_map);
+  if (enable_normal_maps)
+  {
+    float scale = 1;
+
+    files.has_normal_map = loader->readTextureFile("FIELDS", field_name, "", files.normal_map,
+                                                   false, true, &scale, true);
   }
 }
 
 
-void createFieldTextures(ImageGreyScale::ConstPtr type_map_,
-                         render_util::LandTextures &land_textures,
-                         il2ge::RessourceLoader *loader,
-                         bool enable_normal_maps)
+void addMemoryUsage(MemoryStats *stats, const char *type, size_t size)
 {
-  vector<ImageRGBA::Ptr> textures;
-  vector<ImageRGB::Ptr> textures_nm;
-#if 0
-  auto red_texture = make_shared<ImageRGBA>(ivec2(512));
-  image::fill(red_texture, ImageRGBA::PixelType{255, 0, 0, 255});
+  if (stats)
+    stats->add(type, size);
+}
 
-  texture_arrays[getTerrainTextureArrayIndex(red_texture->w())].push_back(red_texture);
-  textures.push_back(red_texture);
-#endif
 
-  std::vector<float> texture_scale;
+void removeMemoryUsage(MemoryStats *stats, const char *type, size_t size)
+{
+  if (stats)
+    stats->remove(type, size);
+}
 
-//   ImageRGBA::Ptr default_normal_map(new ImageRGBA(ivec2(128,128)));
-//   RGBA default_normal = { 127, 127, 255, 255 };
-//   image::fill<RGBA>(default_normal_map, default_normal);
-//   vector<ImageRGBA::ConstPtr> normal_maps;
 
-  for (int i = 0; i < NUM_FIELDS; i++)
+template <class T>
+void visitImage(const char *type, const shared_ptr<T> &image, const ImageVisitor &func)
+{
+  if (image)
+    func(type, image->getDataSize());
+}
+
+
+size_t getSize(const FieldTextureFiles &files)
+{
+  return files.texture.size() + files.normal_map.size();
+}
+
+
+// runs on a worker thread
+void decodeFieldTexture(const char *field_name,
+                        FieldTextureFiles &files,
+                        ImageRGBA::Ptr &texture,
+                        ImageRGB::Ptr &normal_map,
+                        const string &dump_dir)
+{
+  string dump_name = string("FIELDS_") + field_name;
+
+  // decoded flipped, directly into the final images
+  if (files.has_texture)
   {
-    const char *field_name = field_names[i];
+    texture = decodeImage<ImageRGBA>(files.texture, dump_name.c_str(), true);
+    if (texture && isDumpEnabled())
+      dump<ImageRGBA>(image::flipY(texture), dump_name, dump_dir);
+  }
 
-    LOG_TRACE<<"loading texture: "<<field_name<<" ..."<<endl;
+  if (texture)
+    assert(texture->w() == texture->h());
 
-#if 0
-    {
-      string bumpmap_path = path.substr(0, path.find_last_of('.')) + ".BumpH";
-      vector<char> content;
-      if (SFS::readFile(bumpmap_path, content))
-      {
-        dumpFile(string(field_names[i]) + "_bump.tga", content.data(), content.size());
+  if (files.has_normal_map)
+  {
+    normal_map = decodeImage<ImageRGB>(files.normal_map, field_name, true);
+    if (normal_map && isDumpEnabled())
+      dump<ImageRGB>(image::flipY(normal_map), dump_name + "_nm", dump_dir);
+  }
 
-        render_util::ImageGreyScale::Ptr bump_map(render_util::loadImageFromMemory<render_util::ImageGreyScale>(content));
-        assert(bump_map);
-        render_util::ImageRGBA::Ptr normal_map(render_util::createNormalMap(bump_map, 8.0));
+  files = {};
+}
 
-        render_util::saveImageToFile(dump_dir + field_names[i] + "_normal.tga", normal_map.get());
 
-        normal_maps.push_back(image::flipY<ImageRGBA>(normal_map));
-      }
-      else
-        normal_maps.push_back(default_normal_map);
-    }
-#endif
+// single component images only
+template <class T>
+const typename T::ComponentType *getRow(const T &image, int y)
+{
+  return reinterpret_cast<const typename T::ComponentType*>(image.getData()) + y * image.w();
+}
 
-    float scale = 1.0;
 
-    ImageRGBA::Ptr image = getTexture("FIELDS", field_name, "", loader, true, &scale);
+template <class T>
+typename T::ComponentType *getRow(T &image, int y)
+{
+  return reinterpret_cast<typename T::ComponentType*>(image.getData()) + y * image.w();
+}
 
-    if (enable_normal_maps)
-    {
-      std::vector<char> content;
 
-      float scale = 1;
-      bool was_read = false;
+// Creates the missing land_type_map, water_type_map, forest_map and - if small_water_map
+// is given - material_map in a single pass over type_map.
+void deriveTypeMaps(BakedMap &baked_map,
+                    Image<water_map::ChunkType>::ConstPtr small_water_map = {})
+{
+  auto type_map = baked_map.type_map;
+  assert(type_map);
 
-      was_read = loader->readTextureFile("FIELDS", field_name, "", content,
-                                         false, true, &scale, true);
-      if (was_read)
-      {
-        dumpFile(string("FIELDS_") +  field_name + "_nm.tga", content.data(), content.size(),
-                 loader->getDumpDir());
+  auto &table = getFieldClassification();
 
-        auto normal_map = loadImageRGBFromMemory(content, field_name);
-        normal_map = image::flipY(normal_map);
-        textures_nm.push_back(normal_map);
-      }
-      else
-        textures_nm.push_back({});
+  ImageGreyScale::Ptr land_type_map;
+  ImageGreyScale::Ptr water_type_map;
+  ImageGreyScale::Ptr forest_map;
+  TerrainBase::MaterialMap::Ptr material_map;
+
+  if (!baked_map.land_type_map)
+    land_type_map = make_shared<ImageGreyScale>(type_map->getSize());
+  if (!baked_map.water_type_map)
+    water_type_map = make_shared<ImageGreyScale>(type_map->getSize());
+  if (!baked_map.forest_map)
+    forest_map = make_shared<ImageGreyScale>(type_map->getSize());
+  if (!baked_map.material_map && small_water_map)
+  {
+    assert(type_map->w() <= small_water_map->w());
+    assert(type_map->h() <= small_water_map->h());
+    material_map = make_shared<TerrainBase::MaterialMap>(type_map->getSize());
+  }
+
+  const int w = type_map->w();
+
+  for (int y = 0; y < type_map->h(); y++)
+  {
+    auto src = getRow(*type_map, y);
+
+    // each output is written by a separate loop over the row, so these stay simple
+    // table lookups the compiler can vectorize
+    if (land_type_map)
+    {
+      auto dst = getRow(*land_type_map, y);
+      for (int x = 0; x < w; x++)
+        dst[x] = table.land_type[src[x] & 0x1F];
     }
-    else
+
+    if (water_type_map)
     {
-      assert(textures_nm.empty());
+      auto dst = getRow(*water_type_map, y);
+      for (int x = 0; x < w; x++)
+        dst[x] = table.water_type[src[x] & 0x1F];
     }
 
-    if (image)
+    if (forest_map)
     {
-      image = image::flipY(image);
-      assert(image->w() == image->h());
+      auto dst = getRow(*forest_map, y);
+      for (int x = 0; x < w; x++)
+        dst[x] = table.forest[src[x] & 0x1F];
     }
 
-    textures.push_back(image);
-    texture_scale.push_back(scale);
+    if (material_map)
+    {
+      auto dst = getRow(*material_map, y);
+      auto chunk_type = getRow(*small_water_map, y);
+      for (int x = 0; x < w; x++)
+      {
+        assert(chunk_type[x] < NUM_CHUNK_TYPES);
+        dst[x] = table.material[chunk_type[x]][src[x] & 0x1F];
+      }
+    }
   }
 
-  auto type_map = make_shared<ImageGreyScale>(type_map_->getSize());
+  if (land_type_map)
+    baked_map.land_type_map = land_type_map;
+  if (water_type_map)
+    baked_map.water_type_map = water_type_map;
+  if (forest_map)
+    baked_map.forest_map = forest_map;
+  if (material_map)
+    baked_map.material_map = material_map;
+}
 
-  for (int y = 0; y < type_map->h(); y++)
+
+// Fields that use the same file (and scale) share a single slot:
+// Returns for each field the index of the first field using the same file.
+vector<unsigned> findDuplicateFields(il2ge::RessourceLoader *loader)
+{
+  vector<unsigned> canonical_fields(NUM_FIELDS);
+
+  // the dump needs all files
+  if (isDumpEnabled())
   {
-    for (int x = 0; x < type_map->w(); x++)
-    {
-      unsigned int index = type_map_->get(x,y) & 0x1F;
+    for (unsigned i = 0; i < NUM_FIELDS; i++)
+      canonical_fields[i] = i;
+    return canonical_fields;
+  }
 
-      if (strcmp(field_names[index], "Wood1") == 0 ||
-          strcmp(field_names[index], "Wood3") == 0)
-      {
-        index -= 1;
-      }
+  std::map<string, unsigned> fields_by_key;
+
+  for (unsigned i = 0; i < NUM_FIELDS; i++)
+  {
+    canonical_fields[i] = i;
+
+    float scale = 1;
+    auto key = loader->getTextureFileKey("FIELDS", field_names[i], "", false, &scale);
+    if (key.empty())
+      continue;
+
+    key += ',' + to_string(scale);
 
-      type_map->at(x,y) = index;
+    auto res = fields_by_key.insert({ key, i });
+    if (!res.second)
+    {
+      canonical_fields[i] = res.first->second;
+      LOG_DEBUG << field_names[i] << " is the same as " << field_names[canonical_fields[i]] << endl;
     }
   }
 
-  dump(type_map, "type_map", loader->getDumpDir());
+  return canonical_fields;
+}
 
-  land_textures.type_map = type_map;
-  land_textures.textures = textures;
-  land_textures.textures_nm = textures_nm;
-  land_textures.texture_scale = texture_scale;
 
-  LOG_INFO << "generating far texture ..." <<endl;
-  std::vector<ImageRGBA::ConstPtr> textures_const;
-  for (auto texture : textures)
-    textures_const.push_back(texture);
-  land_textures.far_texture =
-    createMapFarTexture(type_map,
-                        textures_const,
-                        TYPE_MAP_METERS_PER_PIXEL,
-                        TERRAIN_METERS_PER_TEXTURE_TILE);
-  dump(land_textures.far_texture, "far_texture", loader->getDumpDir());
+// Makes duplicate fields refer to the slot of the first field using the same file.
+// Applying it again to an already remapped map doesn't change it.
+ImageGreyScale::ConstPtr remapDuplicateFields(ImageGreyScale::ConstPtr land_type_map,
+                                              const vector<unsigned> &canonical_fields)
+{
+  unsigned char remap[256];
+  bool is_identity = true;
+
+  for (unsigned i = 0; i < 256; i++)
+  {
+    remap[i] = i < NUM_FIELDS ? canonical_fields[i] : i;
+    if (remap[i] != i)
+      is_identity = false;
+  }
+
+  if (is_identity)
+    return land_type_map;
+
+  auto remapped = make_shared<ImageGreyScale>(land_type_map->getSize());
+
+  for (int y = 0; y < land_type_map->h(); y++)
+  {
+    auto src = getRow(*land_type_map, y);
+    auto dst = getRow(*remapped, y);
+    for (int x = 0; x < land_type_map->w(); x++)
+      dst[x] = remap[src[x]];
+  }
+
+  return remapped;
 }
 
 
-void createWaterTypeMap(ImageGreyScale::ConstPtr type_map, MapTextures *map_textures, il2ge::RessourceLoader *loader)
+void createFieldTextures(BakedMap &baked_map,
+                         render_util::LandTextures &land_textures,
+                         il2ge::RessourceLoader *loader,
+                         bool enable_normal_maps,
+                         const ProgressFunc &progress = {},
+                         MemoryStats *memory_stats = nullptr,
+                         bool low_memory = false)
 {
-  ImageGreyScale::Ptr water_type_map = image::create<unsigned char>(0, type_map->size());
-  for (int y = 0; y < type_map->h(); y++)
+  assert(baked_map.land_type_map);
+
+  vector<FieldTextureFiles> files(NUM_FIELDS);
+  vector<ImageRGBA::Ptr> textures(NUM_FIELDS);
+  vector<ImageRGB::Ptr> textures_nm;
+  vector<float> texture_scale(NUM_FIELDS);
+
+  if (enable_normal_maps)
+    textures_nm.resize(NUM_FIELDS);
+
+  // has to happen before any file is read, since reading redirects the file
+  auto canonical_fields = findDuplicateFields(loader);
+
+  // normal maps are baked in the background while the textures are being loaded
+  if (enable_normal_maps)
   {
-    for (int x = 0; x < type_map->w(); x++)
+    for (int i = 0; i < NUM_FIELDS; i++)
     {
-      unsigned int index = type_map->get(x,y) & 0x1F;
+      if (canonical_fields[i] == unsigned(i))
+        loader->prepareNormalMap("FIELDS", field_names[i], "", false);
+    }
+  }
 
-      int water_type = glm::clamp((int)index - 28, -1, 31);
-      water_type += 1;
-      assert(water_type >= 0);
-      assert(water_type <= 4);
-//       assert(water_type == 0);
+  {
+    // The loader is only used from this thread - decoding happens in the pool
+    // while the next field is being read.
+    ThreadPool pool(low_memory ? 1 : 0);
+
+    // limits the number of undecoded files and decoded images held at the same time
+    const int max_jobs_in_flight = 2 * pool.getNumThreads();
+    int num_jobs = 0;
+
+    for (int i = 0; i < NUM_FIELDS; i++)
+    {
+      const char *field_name = field_names[i];
+
+      if (canonical_fields[i] != unsigned(i))
+      {
+        // the slot stays empty - the land type map refers to the canonical one instead
+        texture_scale[i] = texture_scale[canonical_fields[i]];
+        continue;
+      }
+
+      if (num_jobs && (num_jobs % max_jobs_in_flight) == 0)
+        pool.wait();
+
+      LOG_TRACE<<"loading texture: "<<field_name<<" ..."<<endl;
+
+      reportProgress(progress, 0.8 * i / NUM_FIELDS, string("Loading texture ") + field_name);
+
+      readFieldTextureFiles(field_name, files[i], loader, enable_normal_maps);
+      texture_scale[i] = files[i].scale;
+
+      addMemoryUsage(memory_stats, "compressed", getSize(files[i]));
+
+      auto dump_dir = loader->getDumpDir();
+
+      pool.submit([i, &files, &textures, &textures_nm, dump_dir, memory_stats]
+      {
+        ImageRGB::Ptr normal_map;
+        auto compressed_size = getSize(files[i]);
 
-      unsigned char water_type_c = water_type;
+        decodeFieldTexture(field_names[i], files[i], textures[i], normal_map, dump_dir);
 
-      assert(water_type_c >= 0);
-      assert(water_type_c <= 4);
+        removeMemoryUsage(memory_stats, "compressed", compressed_size);
+        if (textures[i])
+          addMemoryUsage(memory_stats, "ImageRGBA", textures[i]->getDataSize());
+        if (normal_map)
+          addMemoryUsage(memory_stats, "ImageRGB", normal_map->getDataSize());
 
-      water_type_map->at(x,y) = water_type_c;
+        if (!textures_nm.empty())
+          textures_nm[i] = normal_map;
+      });
+
+      num_jobs++;
     }
+
+    pool.wait();
+  }
+
+  auto land_type_map = remapDuplicateFields(baked_map.land_type_map, canonical_fields);
+  if (land_type_map != baked_map.land_type_map)
+  {
+    // replaces the original
+    addMemoryUsage(memory_stats, "ImageGreyScale", land_type_map->getDataSize());
+    removeMemoryUsage(memory_stats, "ImageGreyScale", baked_map.land_type_map->getDataSize());
+    baked_map.land_type_map = land_type_map;
+  }
+
+  dump(baked_map.land_type_map, "type_map", loader->getDumpDir());
+
+  land_textures.type_map = baked_map.land_type_map;
+  land_textures.textures = textures;
+  land_textures.textures_nm = textures_nm;
+  land_textures.texture_scale = texture_scale;
+
+  if (!baked_map.far_texture)
+  {
+    reportProgress(progress, 0.8, "Generating far texture");
+
+    LOG_INFO << "generating far texture ..." <<endl;
+    std::vector<ImageRGBA::ConstPtr> textures_const;
+    for (auto texture : textures)
+      textures_const.push_back(texture);
+    auto far_texture =
+      createMapFarTexture(baked_map.land_type_map,
+                          textures_const,
+                          TYPE_MAP_METERS_PER_PIXEL,
+                          TERRAIN_METERS_PER_TEXTURE_TILE);
+    dump(far_texture, "far_texture", loader->getDumpDir());
+    addMemoryUsage(memory_stats, "ImageRGBA", far_texture->getDataSize());
+    baked_map.far_texture = far_texture;
   }
-  map_textures->setWaterTypeMap(water_type_map);
+
+  land_textures.far_texture = baked_map.far_texture;
+
+  reportProgress(progress, 1, "Loading textures done");
 }
 
 
-template <typename T, class Container>
-bool loadWaterTexture(const char *prefix,
-                      const char *suffix,
-                      int i,
-                      Container &container,
-                      il2ge::RessourceLoader *loader)
+struct WaterAnimationFrameFiles
+{
+  string normal_map_name;
+  string foam_mask_name;
+  vector<char> normal_map;
+  vector<char> foam_mask;
+};
+
+
+string getWaterTextureName(const char *prefix, int i, const char *suffix)
 {
   char basename[100];
   snprintf(basename, sizeof(basename), "%s%.2d%s", prefix, i, suffix);
-  auto filename = string(basename) + ".tga";
-
-  LOG_TRACE << "loading " << filename << endl;
+  return basename;
+}
 
-  vector<char> data;
-  if (!loader->readWaterAnimation(filename, data))
-  {
-    return false;
-  }
 
-  auto image = loadImageFromMemory<T>(data, filename.c_str());
-  assert(image);
+// expected_size is set from the first texture
+bool checkWaterTextureSize(const string &filename, ivec2 size, ivec2 &expected_size)
+{
+  if (expected_size == ivec2(0))
+    expected_size = size;
 
-  if (i != 0 && image->getSize() != container.at(0)->getSize())
+  if (size != expected_size)
   {
     LOG_WARNING << filename << " has wrong size." << endl;
-    LOG_WARNING << "Expected: " << container.at(0)->getSize() << endl;
-    LOG_WARNING << "Got: " << image->getSize() << endl;
+    LOG_WARNING << "Expected: " << expected_size << endl;
+    LOG_WARNING << "Got: " << size << endl;
     return false;
   }
 
-  dump(image, basename, loader->getDumpDir());
-  container.push_back(image);
-
   return true;
-};
+}
 
 
-void createWaterNormalMaps(render_util::WaterAnimation *water_animation,
-                           render_util::MapTextures *map_textures,
-                           il2ge::RessourceLoader *loader)
+// Only checks formats known to probeImage() - the others are checked once they are decoded.
+bool checkWaterTexture(const string &filename, const vector<char> &data, ivec2 &expected_size)
 {
+  ImageInfo info;
+  if (!probeImage(data, info))
+    return true;
 
-  LOG_INFO << "loading water textures..." << endl;
+  return checkWaterTextureSize(filename, info.size, expected_size);
+}
 
-  //     const char *foam_detail_name = "water_textures/FoamNV40.tga";
-  //     foam_detail_texture = SOIL_load_OGL_texture(foam_detail_name, SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID,
-  //         SOIL_FLAG_MIPMAPS | SOIL_FLAG_TEXTURE_REPEATS);
-  //
-  //     if (!foam_detail_texture) {
-  //       printf("Fail\n");
-  //       exit(1);
-  //     }
 
-  vector<ImageRGBA::ConstPtr> normal_maps;
-  vector<ImageGreyScale::ConstPtr> foam_masks;
+// Reads the files of all frames up to the first missing or mismatching one.
+// Sizes are checked using the headers only, where the format allows it.
+vector<WaterAnimationFrameFiles> readWaterAnimationFrames(il2ge::RessourceLoader *loader)
+{
+  vector<WaterAnimationFrameFiles> frames;
 
-  int i = 0;
+  ivec2 normal_map_size(0);
+  ivec2 foam_mask_size(0);
 
-  while (true)
+  for (int i = 0; ; i++)
   {
-    if (!loadWaterTexture<ImageRGBA>("WaterNoise", "Dot3", i, normal_maps, loader))
+    WaterAnimationFrameFiles frame;
+    frame.normal_map_name = getWaterTextureName("WaterNoise", i, "Dot3");
+    frame.foam_mask_name = getWaterTextureName("WaterNoiseFoam", i, "");
+
+    LOG_TRACE << "reading " << frame.normal_map_name << " / " << frame.foam_mask_name << endl;
+
+    if (!loader->readWaterAnimation(frame.normal_map_name + ".tga", frame.normal_map) ||
+        !loader->readWaterAnimation(frame.foam_mask_name + ".tga", frame.foam_mask))
+    {
       break;
+    }
 
-    if (!loadWaterTexture<ImageGreyScale>("WaterNoiseFoam", "", i, foam_masks, loader))
+    if (!checkWaterTexture(frame.normal_map_name, frame.normal_map, normal_map_size) ||
+        !checkWaterTexture(frame.foam_mask_name, frame.foam_mask, foam_mask_size))
     {
-      normal_maps.pop_back();
       break;
     }
 
-    i++;
+    frames.push_back(move(frame));
+  }
+
+  return frames;
+}
+
+
+void loadWaterNormalMaps(vector<ImageRGBA::ConstPtr> &normal_maps,
+                         vector<ImageGreyScale::ConstPtr> &foam_masks,
+                         il2ge::RessourceLoader *loader)
+{
+  LOG_INFO << "loading water textures..." << endl;
+
+  // the loader is only used from this thread
+  auto frames = readWaterAnimationFrames(loader);
+  auto dump_dir = loader->getDumpDir();
+
+  vector<ImageRGBA::ConstPtr> frame_normal_maps(frames.size());
+  vector<ImageGreyScale::ConstPtr> frame_foam_masks(frames.size());
+
+  {
+    ThreadPool pool;
+
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+      pool.submit([i, &frames, &frame_normal_maps, &frame_foam_masks, dump_dir]
+      {
+        auto &frame = frames[i];
+
+        auto normal_map = decodeImage<ImageRGBA>(frame.normal_map, frame.normal_map_name.c_str());
+        auto foam_mask = decodeImage<ImageGreyScale>(frame.foam_mask, frame.foam_mask_name.c_str());
+
+        if (!normal_map || !foam_mask)
+          return;
+
+        dump(normal_map, frame.normal_map_name, dump_dir);
+        dump(foam_mask, frame.foam_mask_name, dump_dir);
+
+        // the names are still needed for the size check
+        frame.normal_map = {};
+        frame.foam_mask = {};
+
+        frame_normal_maps[i] = normal_map;
+        frame_foam_masks[i] = foam_mask;
+      });
+    }
+
+    pool.wait();
   }
 
-  assert(normal_maps.size() == foam_masks.size());
+  ivec2 normal_map_size(0);
+  ivec2 foam_mask_size(0);
+
+  // like reading, the animation ends at the first frame that failed
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    if (!frame_normal_maps[i] || !frame_foam_masks[i])
+    {
+      LOG_WARNING << "Failed to load water animation frame " << i << endl;
+      break;
+    }
 
-  water_animation->createTextures(map_textures, normal_maps, foam_masks);
+    if (!checkWaterTextureSize(frames[i].normal_map_name,
+                               frame_normal_maps[i]->getSize(), normal_map_size) ||
+        !checkWaterTextureSize(frames[i].foam_mask_name,
+                               frame_foam_masks[i]->getSize(), foam_mask_size))
+    {
+      break;
+    }
+
+    normal_maps.push_back(frame_normal_maps[i]);
+    foam_masks.push_back(frame_foam_masks[i]);
+  }
+
+  LOG_INFO << "loaded " << normal_maps.size() << " water animation frames." << endl;
 }
 
 
@@ -459,18 +814,47 @@ std::shared_ptr<render_util::GenericImage> loadRandomCirrusTexture()
 }
 
 
-void createCirrusTextures(MapBase *map,
-                          il2ge::RessourceLoader *loader)
+std::shared_ptr<render_util::GenericImage> loadCirrusTexture(il2ge::RessourceLoader *loader)
 {
   auto cirrus_texture = loadRandomCirrusTexture();
   if (!cirrus_texture)
     cirrus_texture = getTexture<GenericImage>("APPENDIX", "HighClouds", "", false, loader);
 //   auto cirrus_noise_texture = getTexture<GenericImage>("APPENDIX", "HighCloudsNoise", "", false, loader);
 
-  map->setCirrusTexture(cirrus_texture);
+  return cirrus_texture;
 }
 
 
+void bakeTypeMaps(il2ge::RessourceLoader *loader, BakedMap &baked_map,
+                  const ProgressFunc &progress = {})
+{
+  auto type_map = baked_map.type_map;
+  assert(type_map);
+
+  render_util::Image<water_map::ChunkType>::Ptr small_water_map;
+
+  if (!baked_map.water_map_table || !baked_map.material_map)
+  {
+    reportProgress(progress, 0, "Creating water map");
+
+    LOG_DEBUG<<"creating water map ..."<<endl;
+    il2ge::WaterMap water_map;
+    createWaterMap(
+      type_map->size(),
+      loader,
+      water_map,
+      small_water_map);
+    LOG_DEBUG<<"creating water map done."<<endl;
+
+    baked_map.water_map_chunks = water_map.chunks;
+    baked_map.water_map_table = water_map.table;
+  }
+
+  reportProgress(progress, 0.5, "Creating type maps");
+
+  deriveTypeMaps(baked_map, small_water_map);
+}
+
 
 } // namespace
 
@@ -494,13 +878,145 @@ void createLandTextures(il2ge::RessourceLoader *loader,
                         LandTextures &land_textures,
                         bool enable_normal_maps)
 {
-  createFieldTextures(type_map, land_textures, loader, enable_normal_maps);
+  BakedMap baked_map;
+  baked_map.type_map = type_map;
+  deriveTypeMaps(baked_map);
+
+  createFieldTextures(baked_map, land_textures, loader, enable_normal_maps);
+}
+
+
+std::vector<InputFile> getBakedMapInputFiles()
+{
+  std::vector<InputFile> files;
+
+  auto add = [&files] (const char *section, const char *name, const char *default_path,
+                       const char *suffix, bool is_texture, bool from_map_dir)
+  {
+    InputFile file;
+    file.section = section;
+    file.name = name;
+    file.default_path = default_path;
+    file.suffix = suffix;
+    file.is_texture = is_texture;
+    file.from_map_dir = from_map_dir;
+    files.push_back(file);
+  };
+
+  add("MAP", "HeightMap", "map_h.tga", nullptr, true, true);
+  add("MAP", "TypeMap", "map_T.tga", nullptr, true, true);
+  add("MAP", "ColorMap", "map_c.tga", nullptr, true, true);
+  add("MAP", "ColorMap", "map_c.tga", "_table", false, true);
+
+  // needed for the far texture
+  for (int i = 0; i < NUM_FIELDS; i++)
+    add("FIELDS", field_names[i], "", nullptr, true, false);
+
+  return files;
+}
+
+
+void bakeMap(il2ge::RessourceLoader *loader, BakedMap &baked_map, ProgressFunc progress)
+{
+  reportProgress(progress, 0, "Loading height map");
+
+  if (!baked_map.pixel_map_h)
+    baked_map.pixel_map_h = createPixelMapH(loader);
+
+  if (!baked_map.elevation_map)
+    baked_map.elevation_map = createElevationMap(baked_map.pixel_map_h);
+
+  reportProgress(progress, 0.2, "Loading type map");
+
+  if (!baked_map.type_map)
+    baked_map.type_map = createTypeMap(loader);
+
+  bakeTypeMaps(loader, baked_map, [&progress] (float fraction, const string &description)
+  {
+    reportProgress(progress, 0.3 + 0.7 * fraction, description);
+  });
+
+  reportProgress(progress, 1, "Baking map done");
+}
+
+
+void createLandTextures(il2ge::RessourceLoader *loader,
+                        BakedMap &baked_map,
+                        LandTextures &land_textures,
+                        bool enable_normal_maps,
+                        ProgressFunc progress,
+                        MemoryStats *memory_stats,
+                        bool low_memory)
+{
+  createFieldTextures(baked_map, land_textures, loader, enable_normal_maps, progress,
+                      memory_stats, low_memory);
+}
+
+
+void visitImages(const BakedMap &map, const ImageVisitor &func)
+{
+  auto visit = [&func] (const char *type, auto &image) { visitImage(type, image, func); };
+
+  visit("ImageGreyScale", map.pixel_map_h);
+  visit("ElevationMap", map.elevation_map);
+  visit("ImageGreyScale", map.type_map);
+  visit("ImageGreyScale", map.land_type_map);
+  visit("ImageGreyScale", map.water_type_map);
+  visit("ImageGreyScale", map.forest_map);
+  visit("MaterialMap", map.material_map);
+  for (auto &chunk : map.water_map_chunks)
+    visit("ImageGreyScale", chunk);
+  visit("WaterMapTable", map.water_map_table);
+  visit("ImageRGBA", map.far_texture);
+}
+
+
+void visitImages(const MapTextureImages &images, const ImageVisitor &func)
+{
+  auto visit = [&func] (const char *type, auto &image) { visitImage(type, image, func); };
+
+  for (auto &image : images.water_normal_maps)
+    visit("ImageRGBA", image);
+  for (auto &image : images.water_foam_masks)
+    visit("ImageGreyScale", image);
+  visit("ImageGreyScale", images.noise_texture);
+  visit("ImageRGBA", images.shallow_water);
+  for (auto &image : images.beach)
+    visit("ImageRGBA", image);
+  visit("ImageRGBA", images.forest_far_texture);
+  for (auto &image : images.forest_layers)
+    visit("ImageRGBA", image);
+  visit("GenericImage", images.cirrus_texture);
+}
+
+
+void visitImages(const LandTextures &land_textures, const ImageVisitor &func)
+{
+  auto visit = [&func] (const char *type, auto &image) { visitImage(type, image, func); };
+
+  // type_map and far_texture are shared with BakedMap
+  for (auto &image : land_textures.textures)
+    visit("ImageRGBA", image);
+  for (auto &image : land_textures.textures_nm)
+    visit("ImageRGB", image);
 }
 
 
 void createMapTextures(il2ge::RessourceLoader *loader,
                        ImageGreyScale::ConstPtr type_map,
                        render_util::MapBase *map)
+{
+  BakedMap baked_map;
+  baked_map.type_map = type_map;
+  bakeTypeMaps(loader, baked_map);
+
+  createMapTextures(loader, baked_map, map);
+}
+
+
+void loadMapTextureImages(il2ge::RessourceLoader *loader,
+                          MapTextureImages &images,
+                          ProgressFunc progress)
 {
 //   getTexture("APPENDIX", "BeachFoam", "", reader);
 //   getTexture("APPENDIX", "BeachSurf", "", reader);
@@ -513,118 +1029,103 @@ void createMapTextures(il2ge::RessourceLoader *loader,
 //   getTexture("APPENDIX", "WaterNoise", "", loader, true);
 //   getTexture("WOOD", "WoodMiniMasks", "", loader, true);
 
-  auto map_textures = &map->getTextures();
-  auto water_animation = &map->getWaterAnimation();
+  reportProgress(progress, 0, "Loading water textures");
+
+  loadWaterNormalMaps(images.water_normal_maps, images.water_foam_masks, loader);
 
-  createWaterNormalMaps(water_animation, map_textures, loader);
+  reportProgress(progress, 0.5, "Loading textures");
 
 #if 1
-  LOG_DEBUG<<"creating water map ..."<<endl;
-  il2ge::WaterMap water_map;
-  render_util::Image<water_map::ChunkType>::Ptr small_water_map;
-  createWaterMap(
-    type_map->size(),
-    loader,
-    water_map,
-    small_water_map);
-  LOG_DEBUG<<"creating water map done."<<endl;
-  map_textures->setWaterMap(water_map.chunks, water_map.table);
+//   LOG_INFO<<"loading noise texture ..."<<endl;
+  images.noise_texture = getTexture<ImageGreyScale>("APPENDIX", "ShadeNoise", "land/Noise.tga", false, loader);
+  assert(images.noise_texture);
 #endif
 
-  createWaterTypeMap(type_map, map_textures, loader);
+  TextureMemo textures(loader);
 
-  auto material_map = image::convert<TerrainBase::MaterialMap::ComponentType>(type_map);
-
-  material_map->forEach
-  (
-    [] (auto &pixel)
-    {
-      unsigned int material = 0;
-      if (isForest(pixel & 0x1F))
-        material = TerrainBase::MaterialID::FOREST;
-      else
-        material = TerrainBase::MaterialID::LAND;
-      pixel = material;
-    }
-  );
+#if 1
+  images.shallow_water = textures.get("FIELDS", "Water2");
+  assert(images.shallow_water);
 
-  assert(material_map->w() <= small_water_map->w());
-  assert(material_map->h() <= small_water_map->h());
+  ImageRGBA::ConstPtr beach_foam = textures.get("APPENDIX", "BeachFoam");
+  assert(beach_foam);
+  images.beach.push_back(beach_foam);
 
-  for (int y = 0; y < material_map->h(); y++)
-  {
-    for (int x = 0; x < material_map->w(); x++)
-    {
-      unsigned int material = material_map->get(x,y);
-      switch (small_water_map->get(x,y))
-      {
-        case water_map::CHUNK_EMPTY:
-          material = TerrainBase::MaterialID::WATER;
-          break;
-        case water_map::CHUNK_MIXED:
-          material |= TerrainBase::MaterialID::WATER;
-        case water_map::CHUNK_FULL:
-          break;
-      }
-      material_map->at(x,y) = material;
-    }
-  }
+  ImageRGBA::ConstPtr beach_surf = textures.get("APPENDIX", "BeachSurf");
+  assert(beach_surf);
+  images.beach.push_back(beach_surf);
 
-  map->setMaterialMap(material_map);
+  ImageRGBA::ConstPtr beach_land = textures.get("APPENDIX", "BeachLand");
+  assert(beach_land);
+  images.beach.push_back(beach_land);
 
-#if 1
-//   LOG_INFO<<"loading noise texture ..."<<endl;
-  ImageGreyScale::Ptr noise_texture = getTexture<ImageGreyScale>("APPENDIX", "ShadeNoise", "land/Noise.tga", false, loader);
-  assert(noise_texture);
-  map_textures->setTexture(TEXUNIT_TERRAIN_NOISE, noise_texture);
+  images.water_color = loader->getWaterColor(default_water_color);
 #endif
 
-#if 1
-  ImageRGBA::Ptr shallow_water = getTexture("FIELDS", "Water2", "", loader);
-  assert(shallow_water);
-  map_textures->setTexture(TEXUNIT_SHALLOW_WATER, shallow_water);
+  reportProgress(progress, 0.7, "Loading forest textures");
 
-  vector<ImageRGBA::ConstPtr> beach;
+  LOG_DEBUG<<"loading forest texture ..."<<endl;
+  images.forest_far_texture = loadForestFarTexture(textures);
+  images.forest_layers = loadForestLayers(textures);
+  assert(!images.forest_layers.empty());
+  LOG_DEBUG<<"loading forest texture done."<<endl;
 
-  ImageRGBA::ConstPtr beach_foam = getTexture("APPENDIX", "BeachFoam", "", loader);
-  assert(beach_foam);
-  beach.push_back(beach_foam);
+  images.cirrus_texture = loadCirrusTexture(loader);
 
-  ImageRGBA::ConstPtr beach_surf = getTexture("APPENDIX", "BeachSurf", "", loader);
-  assert(beach_surf);
-  beach.push_back(beach_surf);
+  reportProgress(progress, 1, "Loading textures done");
+}
 
-  ImageRGBA::ConstPtr beach_land = getTexture("APPENDIX", "BeachLand", "", loader);
-  assert(beach_land);
-  beach.push_back(beach_land);
 
-  map_textures->setBeach(beach);
+void createMapTextures(const BakedMap &baked_map,
+                       const MapTextureImages &images,
+                       render_util::MapBase *map)
+{
+  auto map_textures = &map->getTextures();
+  auto water_animation = &map->getWaterAnimation();
 
-  map_textures->setWaterColor(loader->getWaterColor(default_water_color));
-#endif
+  water_animation->createTextures(map_textures, images.water_normal_maps, images.water_foam_masks);
 
-  createForestTextures(type_map, map_textures, loader);
+  assert(baked_map.water_map_table);
+  map_textures->setWaterMap(baked_map.water_map_chunks, baked_map.water_map_table);
 
-  createCirrusTextures(map, loader);
+  assert(baked_map.water_type_map);
+  map_textures->setWaterTypeMap(baked_map.water_type_map);
+
+  assert(baked_map.material_map);
+  map->setMaterialMap(baked_map.material_map);
+
+  map_textures->setTexture(TEXUNIT_TERRAIN_NOISE, images.noise_texture);
+  map_textures->setTexture(TEXUNIT_SHALLOW_WATER, images.shallow_water);
+  map_textures->setBeach(images.beach);
+  map_textures->setWaterColor(images.water_color);
+
+  assert(baked_map.forest_map);
+  map_textures->setForestMap(baked_map.forest_map);
+  map_textures->setTexture(TEXUNIT_FOREST_FAR, images.forest_far_texture);
+  map_textures->setForestLayers(images.forest_layers);
+
+  map->setCirrusTexture(images.cirrus_texture);
 
   LOG_INFO<<"creating map textures done."<<endl;
 }
 
 
+void createMapTextures(il2ge::RessourceLoader *loader,
+                       const BakedMap &baked_map,
+                       render_util::MapBase *map)
+{
+  MapTextureImages images;
+  loadMapTextureImages(loader, images);
+  createMapTextures(baked_map, images, map);
+}
+
+
 bool isForest(unsigned int index)
 {
   assert(index < NUM_FIELDS);
 
   if (index < NUM_FIELDS)
-    return
-      strcmp(field_names[index], "Wood0") == 0
-      ||
-      strcmp(field_names[index], "Wood1") == 0
-      ||
-      strcmp(field_names[index], "Wood2") == 0
-      ||
-      strcmp(field_names[index], "Wood3") == 0
-      ;
+    return getFieldClassification().is_forest[index];
   else
     return false;
 }
@@ -656,6 +1157,23 @@ ImageRGBA::Ptr getTexture(const char *section,
 }
 
 
+ImageRGBA::ConstPtr TextureMemo::get(const char *section,
+                                     const char *name,
+                                     const char *default_path)
+{
+  auto key = string(section) + '/' + name;
+
+  auto it = m_textures.find(key);
+  if (it != m_textures.end())
+    return it->second;
+
+  ImageRGBA::ConstPtr texture = getTexture(section, name, default_path, m_loader);
+  m_textures[key] = texture;
+
+  return texture;
+}
+
+
 void createChunks(render_util::ImageGreyScale::ConstPtr image,
                           int chunk_size,
                           std::vector<render_util::ImageGreyScale::ConstPtr> &chunks)
@@ -663,14 +1181,22 @@ void createChunks(render_util::ImageGreyScale::ConstPtr image,
   int chunks_per_row = image->w() / chunk_size;
   int num_rows = image->h() / chunk_size;
 
+  chunks.reserve(chunks.size() + chunks_per_row * num_rows);
+
   for (int y = 0; y < num_rows; y++)
   {
     for (int x = 0; x < chunks_per_row; x++)
     {
-      ImageGreyScale::Ptr chunk =
-        image::subImage(image.get(), x * chunk_size, y * chunk_size, chunk_size, chunk_size);
+      // copy the rows flipped, instead of subImage() followed by flipY()
+      auto chunk = make_shared<ImageGreyScale>(ivec2(chunk_size));
+
+      for (int chunk_y = 0; chunk_y < chunk_size; chunk_y++)
+      {
+        auto src = getRow(*image, y * chunk_size + chunk_y) + x * chunk_size;
+        auto dst = getRow(*chunk, chunk_size - 1 - chunk_y);
+        memcpy(dst, src, chunk_size);
+      }
 
-      chunk = image::flipY(chunk);
       chunks.push_back(chunk);
     }
   }
@@ -687,17 +1213,21 @@ render_util::ImageGreyScale::Ptr createPixelMapH(il2ge::RessourceLoader *loader)
 }
 
 
+void decodeElevation(const unsigned char *__restrict indices,
+                     float *__restrict elevation,
+                     size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+    elevation[i] = elevation_table[indices[i]];
+}
+
+
 render_util::ElevationMap::Ptr createElevationMap(render_util::ImageGreyScale::ConstPtr height_map)
 {
   auto elevation_map = make_shared<ElevationMap>(height_map->getSize());
+
   for (int y = 0; y < elevation_map->h(); y++)
-  {
-    for (int x = 0; x < elevation_map->w(); x++)
-    {
-      unsigned char elevation_index = height_map->get(x,y);
-      elevation_map->at(x,y) = elevation_table[elevation_index];
-    }
-  }
+    decodeElevation(getRow(*height_map, y), getRow(*elevation_map, y), elevation_map->w());
 
   return elevation_map;
 }
@@ -28,6 +28,7 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <map>
 
 
 namespace il2ge::map_loader
@@ -103,6 +104,24 @@ typename std::shared_ptr<T> getTexture(const char *section,
 }
 
 
+// Textures decoded during one load, keyed by section/name,
+// so each one is read and decoded only once. Not thread safe.
+class TextureMemo
+{
+  il2ge::RessourceLoader *m_loader = nullptr;
+  std::map<std::string, render_util::ImageRGBA::ConstPtr> m_textures;
+
+public:
+  TextureMemo(il2ge::RessourceLoader *loader) : m_loader(loader) {}
+
+  il2ge::RessourceLoader *getLoader() { return m_loader; }
+
+  render_util::ImageRGBA::ConstPtr get(const char *section,
+                                       const char *name,
+                                       const char *default_path = "");
+};
+
+
 void createChunks(render_util::ImageGreyScale::ConstPtr image, int chunk_size, std::vector<render_util::ImageGreyScale::ConstPtr> &chunks);
 unsigned getFieldIndex(const std::string &name);
 
@@ -19,9 +19,14 @@
 #include "water_map.h"
 #include <render_util/image_util.h>
 #include <render_util/terrain_base.h>
+#include <il2ge/thread_pool.h>
 
 #include <glm/glm.hpp>
 #include <iostream>
+#include <map>
+#include <unordered_map>
+#include <cstring>
+#include <cstdint>
 
 using namespace glm;
 using namespace std;
@@ -41,6 +46,8 @@ enum
   ORIG_CHUNK_SIZE_M = 1600,
 };
 
+constexpr size_t WATER_MAP_TABLE_HEADER_SIZE = 16;
+
 render_util::ImageGreyScale::Ptr createEmptyImage(int size)
 {
   return render_util::image::create<unsigned char>(0, ivec2(size));
@@ -53,27 +60,53 @@ render_util::ImageGreyScale::Ptr createFullImage(int size)
 }
 
 
+// shared by all super chunks - never modified
+render_util::ImageGreyScale::ConstPtr getFullTile()
+{
+  static const render_util::ImageGreyScale::ConstPtr tile = createFullImage(ORIG_CHUNK_SIZE);
+  return tile;
+}
+
+
+uint64_t getContentHash(const render_util::ImageGreyScale &image)
+{
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+
+  auto data = image.getData();
+  for (size_t i = 0; i < image.getDataSize(); i++)
+  {
+    hash ^= data[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+
+bool isSameContent(const render_util::ImageGreyScale &a, const render_util::ImageGreyScale &b)
+{
+  return a.getSize() == b.getSize() &&
+         memcmp(a.getData(), b.getData(), a.getDataSize()) == 0;
+}
+
+
 ChunkType classifyChunk(render_util::ImageGreyScale::ConstPtr image)
 {
+  const unsigned char *data = image->getData();
+  const int size = image->getDataSize();
+
+  // branch free, so it gets vectorized
   int num_empty = 0;
   int num_full = 0;
-  int num_other = 0;
-
-  for (int y = 0; y < image->w(); y++)
+  for (int i = 0; i < size; i++)
   {
-    for (int x = 0; x < image->h(); x++)
-    {
-      unsigned int color = image->get(x,y);
-
-      if (color == 0)
-        num_empty++;
-      else if (color == 255)
-        num_full++;
-      else
-        num_other++;
-    }
+    num_empty += data[i] == 0;
+    num_full += data[i] == 255;
   }
 
+  int num_other = size - num_empty - num_full;
+
   if (num_other)
     return CHUNK_MIXED;
   else
@@ -92,10 +125,15 @@ class Chunk
 {
   render_util::ImageGreyScale::ConstPtr m_image;
   ChunkType m_type = CHUNK_MIXED;
+  // chunks with equal content have the same id
+  int m_content_id = -1;
 
 public:
   ChunkType getType() { return m_type; }
 
+  int getContentID() { return m_content_id; }
+  void setContentID(int id) { m_content_id = id; }
+
   bool isEmpty() const
   {
     return m_type == CHUNK_EMPTY;
@@ -179,6 +217,34 @@ public:
   bool isFull() { return sub_chunks.size() == num_full_chunks; }
   bool isEmpty() { return !num_chunks; }
 
+  // Super chunks with the same key have the same image.
+  vector<int> getKey()
+  {
+    enum { NONE = -1, FULL = -2 };
+
+    vector<int> key;
+    key.reserve(sub_chunks.size());
+
+    for (int y = 0; y < h(); y++)
+    {
+      for (int x = 0; x < w(); x++)
+      {
+        Chunk *chunk = sub_chunks.at(x, y);
+        if (!chunk)
+          key.push_back(NONE);
+        else if (chunk->isFull())
+          key.push_back(FULL);
+        else
+        {
+          assert(chunk->getContentID() >= 0);
+          key.push_back(chunk->getContentID());
+        }
+      }
+    }
+
+    return key;
+  }
+
   render_util::ImageGreyScale::Ptr createImage()
   {
     assert(!isFull() && !isEmpty());
@@ -225,7 +291,7 @@ public:
 
           if (chunk->isFull())
           {
-            src = createFullImage(ORIG_CHUNK_SIZE);
+            src = getFullTile();
 //               static auto src = createFullImage(ORIG_CHUNK_SIZE);
 //               render_util::image::blit<render_util::ImageGreyScale>(src.get(), image.get(), pos);
           }
@@ -265,7 +331,8 @@ public:
               h--;
             }
 #endif
-            src = render_util::image::subImage(src.get(), x, y, w, h);
+            if (w != src->w() || h != src->h())
+              src = render_util::image::subImage(src.get(), x, y, w, h);
           }
           else
           {
@@ -296,18 +363,63 @@ public:
 
   Map(const WaterMap &src) : chunks(src.table->w(), src.table->h())
   {
+    // classify each source chunk once and give chunks with equal content the same id
+    vector<ChunkType> types(src.chunks.size());
+    vector<uint64_t> hashes(src.chunks.size());
+    vector<int> content_ids(src.chunks.size());
+    unordered_map<uint64_t, vector<int>> ids_by_hash;
+
+    {
+      il2ge::ThreadPool pool;
+      const size_t batch_size = 256;
+
+      for (size_t begin = 0; begin < src.chunks.size(); begin += batch_size)
+      {
+        pool.submit([begin, batch_size, &src, &types, &hashes]
+        {
+          for (size_t i = begin; i < std::min(begin + batch_size, src.chunks.size()); i++)
+          {
+            types[i] = classifyChunk(src.chunks[i]);
+            hashes[i] = getContentHash(*src.chunks[i]);
+          }
+        });
+      }
+
+      pool.wait();
+    }
+
+    for (size_t i = 0; i < src.chunks.size(); i++)
+    {
+      auto &image = src.chunks[i];
+
+      content_ids[i] = i;
+
+      auto &candidates = ids_by_hash[hashes[i]];
+      for (auto id : candidates)
+      {
+        if (isSameContent(*src.chunks[id], *image))
+        {
+          content_ids[i] = id;
+          break;
+        }
+      }
+      if (content_ids[i] == int(i))
+        candidates.push_back(i);
+    }
+
     for (int y = 0; y < src.table->h(); y++)
     {
       for (int x = 0; x < src.table->w(); x++)
       {
+        // checked by parseWaterMapTable()
         unsigned int index = src.table->get(x,y);
         assert(index < src.chunks.size());
 
         Chunk &dst_chunk = chunks.at(x, y);
-        render_util::ImageGreyScale::ConstPtr image = src.chunks[index];
 
-        dst_chunk.setImage(image);
-        dst_chunk.setType(classifyChunk(image));
+        dst_chunk.setImage(src.chunks[content_ids[index]]);
+        dst_chunk.setType(types[index]);
+        dst_chunk.setContentID(content_ids[index]);
       }
     }
   }
@@ -354,6 +466,8 @@ void fillWaterMap(Map &src, WaterMap &dst)
   render_util::Image<unsigned int>::Ptr table;
   table.reset(new render_util::Image<unsigned int>(ivec2(src.w(), src.h())));
 
+  std::map<const render_util::ImageGreyScale*, unsigned int> indices;
+
   for (int y = 0; y < src.h(); y++)
   {
     for (int x = 0; x < src.w(); x++)
@@ -367,8 +481,11 @@ void fillWaterMap(Map &src, WaterMap &dst)
       }
       else if (!chunk->isEmpty())
       {
-        dst.chunks.push_back(chunk->getImage());
-        index = dst.chunks.size() - 1;
+        // chunks sharing an image share the layer
+        auto res = indices.insert({ chunk->getImage().get(), dst.chunks.size() });
+        if (res.second)
+          dst.chunks.push_back(chunk->getImage());
+        index = res.first->second;
       }
 
       table->at(x,y) = index;
@@ -388,17 +505,21 @@ render_util::Image<ChunkType>::Ptr createSmallMap(Map &map)
   const ivec2 size = ivec2(map.w(), map.h()) * pixel_per_chunk;
 
   auto dst_map = make_shared<render_util::Image<ChunkType>>(size);
+  auto dst_data = reinterpret_cast<ChunkType*>(dst_map->getData());
 
-  for (int y = 0; y < dst_map->h(); y++)
+  // one 8x8 block per chunk
+  for (int chunk_y = 0; chunk_y < map.h(); chunk_y++)
   {
-    for (int x = 0; x < dst_map->w(); x++)
+    for (int chunk_x = 0; chunk_x < map.w(); chunk_x++)
     {
-      ivec2 chunk_coords = ivec2(x,y) / pixel_per_chunk;
-      Chunk *chunk = map.getChunk(chunk_coords);
+      ChunkType type = map.getChunk(ivec2(chunk_x, chunk_y))->getType();
 
-      dst_map->at(x,y) = chunk->getType();
+      for (int y = 0; y < pixel_per_chunk; y++)
+      {
+        auto row = dst_data + (chunk_y * pixel_per_chunk + y) * size.x + chunk_x * pixel_per_chunk;
+        std::fill(row, row + pixel_per_chunk, type);
+      }
     }
-
   }
 
   return dst_map;
@@ -412,6 +533,61 @@ namespace il2ge
 {
 
 
+bool parseWaterMapTable(const char *data,
+                        size_t data_size,
+                        ivec2 table_size,
+                        size_t num_chunks,
+                        render_util::Image<unsigned int>::Ptr &table,
+                        std::string &error)
+{
+  if (table_size.x <= 0 || table_size.y <= 0)
+  {
+    error = "invalid table size";
+    return false;
+  }
+
+  const size_t row_size = table_size.x * sizeof(uint32_t);
+  const size_t required_size = WATER_MAP_TABLE_HEADER_SIZE + row_size * table_size.y;
+
+  if (data_size < required_size)
+  {
+    error = "table has " + to_string(data_size) + " bytes, expected at least "
+          + to_string(required_size);
+    return false;
+  }
+
+  auto parsed = make_shared<render_util::Image<unsigned int>>(table_size);
+
+  auto src = reinterpret_cast<const unsigned char*>(data) + WATER_MAP_TABLE_HEADER_SIZE;
+  auto dst_data = reinterpret_cast<unsigned int*>(parsed->getData());
+
+  for (int y = 0; y < table_size.y; y++)
+  {
+    auto src_row = src + y * row_size;
+    auto dst_row = dst_data + (table_size.y - 1 - y) * table_size.x;
+
+    for (int x = 0; x < table_size.x; x++)
+    {
+      auto value = src_row + x * sizeof(uint32_t);
+      dst_row[x] = uint32_t(value[0]) << 24 |
+                   uint32_t(value[1]) << 16 |
+                   uint32_t(value[2]) << 8 |
+                   uint32_t(value[3]);
+
+      if (dst_row[x] >= num_chunks)
+      {
+        error = "entry " + to_string(x) + "," + to_string(y) + " refers to chunk "
+              + to_string(dst_row[x]) + ", but there are only " + to_string(num_chunks);
+        return false;
+      }
+    }
+  }
+
+  table = parsed;
+  return true;
+}
+
+
 void convertWaterMap(const WaterMap &src,
                      WaterMap &dst,
                      render_util::Image<ChunkType>::Ptr &small_map)
@@ -420,6 +596,11 @@ void convertWaterMap(const WaterMap &src,
 
   Map dst_map(ceil((float)src_map.w() / SUPER_CHUNK_SIZE), ceil((float)src_map.h() / SUPER_CHUNK_SIZE));
 
+  // super chunks made of the same sub chunks share one image
+  std::map<vector<int>, int> super_chunk_indices;
+  vector<SuperChunk> unique_super_chunks;
+  vector<int> super_chunk_index(dst_map.w() * dst_map.h(), -1);
+
   for (int y = 0; y < dst_map.h(); y++)
   {
     for (int x = 0; x < dst_map.w(); x++)
@@ -439,11 +620,43 @@ void convertWaterMap(const WaterMap &src,
       }
       else
       {
-        dst_chunk->setImage(super_chunk.createImage());
+        auto res = super_chunk_indices.insert({ super_chunk.getKey(), unique_super_chunks.size() });
+        if (res.second)
+          unique_super_chunks.push_back(super_chunk);
+        super_chunk_index[y * dst_map.w() + x] = res.first->second;
       }
     }
   }
 
+  // The images are built in parallel - the workers only read src_map.
+  vector<render_util::ImageGreyScale::ConstPtr> super_chunk_images(unique_super_chunks.size());
+
+  {
+    il2ge::ThreadPool pool;
+    const size_t batch_size = 16;
+
+    for (size_t begin = 0; begin < unique_super_chunks.size(); begin += batch_size)
+    {
+      pool.submit([begin, batch_size, &unique_super_chunks, &super_chunk_images]
+      {
+        for (size_t i = begin; i < std::min(begin + batch_size, unique_super_chunks.size()); i++)
+          super_chunk_images[i] = unique_super_chunks[i].createImage();
+      });
+    }
+
+    pool.wait();
+  }
+
+  for (int y = 0; y < dst_map.h(); y++)
+  {
+    for (int x = 0; x < dst_map.w(); x++)
+    {
+      int index = super_chunk_index[y * dst_map.w() + x];
+      if (index >= 0)
+        dst_map.getChunk(ivec2(x, y))->setImage(super_chunk_images[index]);
+    }
+  }
+
   fillWaterMap(dst_map, dst);
   small_map = createSmallMap(src_map);
 }
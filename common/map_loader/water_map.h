@@ -18,7 +18,9 @@
 
 #include <render_util/image.h>
 
+#include <glm/glm.hpp>
 #include <vector>
+#include <string>
 
 namespace il2ge
 {
@@ -39,6 +41,15 @@ namespace il2ge
     render_util::Image<unsigned int>::ConstPtr table;
   };
 
+  // Decodes the big endian chunk table stored in the "_table" file, flipping it vertically.
+  // Returns false and sets error if the data is malformed or refers to a chunk >= num_chunks.
+  bool parseWaterMapTable(const char *data,
+                          size_t data_size,
+                          glm::ivec2 table_size,
+                          size_t num_chunks,
+                          render_util::Image<unsigned int>::Ptr &table,
+                          std::string &error);
+
   void convertWaterMap(const WaterMap &src,
                        WaterMap &dst,
                        render_util::Image<water_map::ChunkType>::Ptr &small_map);
@@ -28,6 +28,10 @@ namespace il2ge
 
 constexpr int MAX_LAYERS = 8;
 
+const ParameterFile::Key KEY_BASED_ON = "BasedOn";
+const ParameterFile::Key KEY_DOUBLE_SIDE = "tfDoubleSide";
+const ParameterFile::Key KEY_TEXTURE_NAME = "TextureName";
+
 
 void Material::applyParameters(ParameterFiles &files, std::string path)
 {
@@ -40,7 +44,7 @@ void Material::applyParameters(ParameterFiles &files, std::string path)
     auto &class_info = params.getSection("ClassInfo");
 
     std::string based_on;
-    class_info.get_noexcept("BasedOn", based_on);
+    class_info.get_noexcept(KEY_BASED_ON, based_on);
 
     if (!based_on.empty())
       applyParameters(files, dir + '/' + based_on);
@@ -49,7 +53,7 @@ void Material::applyParameters(ParameterFiles &files, std::string path)
   if (params.hasSection("General"))
   {
     auto &general = params.getSection("General");
-    general.get_noexcept("tfDoubleSide", this->tfDoubleSide);
+    general.get_noexcept(KEY_DOUBLE_SIDE, this->tfDoubleSide);
   }
 
   for (size_t i = 0; i < MAX_LAYERS; i++)
@@ -67,9 +71,13 @@ void Material::applyParameters(ParameterFiles &files, std::string path)
       auto &layer = m_layers.at(i);
 
       string texture_name;
-      section.get_noexcept("TextureName", texture_name);
+      section.get_noexcept(KEY_TEXTURE_NAME, texture_name);
 
-      #define GET_PARAMETER(p) { section.get_noexcept(#p, layer.p); }
+      #define GET_PARAMETER(p) \
+      { \
+        static const ParameterFile::Key key = #p; \
+        section.get_noexcept(key, layer.p); \
+      }
       GET_PARAMETER(tfBlend);
       GET_PARAMETER(tfBlendAdd);
       GET_PARAMETER(tfNoTexture);
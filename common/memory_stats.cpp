@@ -0,0 +1,188 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <il2ge/memory_stats.h>
+#include <log.h>
+
+#include <algorithm>
+#include <cassert>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#include <fstream>
+#endif
+
+using namespace std;
+
+
+namespace
+{
+
+
+string formatSize(size_t bytes)
+{
+  return to_string(bytes / (1024 * 1024)) + " MB";
+}
+
+
+} // namespace
+
+
+namespace il2ge
+{
+
+
+#ifdef _WIN32
+
+ProcessMemoryInfo getProcessMemoryInfo()
+{
+  ProcessMemoryInfo info;
+
+  PROCESS_MEMORY_COUNTERS counters {};
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+  {
+    info.current = counters.PagefileUsage;
+    info.peak = counters.PeakPagefileUsage;
+  }
+
+  MEMORYSTATUSEX status {};
+  status.dwLength = sizeof(status);
+  if (GlobalMemoryStatusEx(&status))
+    info.address_space = status.ullTotalVirtual - status.ullAvailVirtual;
+
+  return info;
+}
+
+#else
+
+ProcessMemoryInfo getProcessMemoryInfo()
+{
+  ProcessMemoryInfo info;
+
+  struct rusage usage {};
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    info.peak = size_t(usage.ru_maxrss) * 1024;
+
+  ifstream statm("/proc/self/statm");
+  size_t size = 0;
+  size_t resident = 0;
+  if (statm >> size >> resident)
+  {
+    info.current = resident * sysconf(_SC_PAGESIZE);
+    info.address_space = size * sysconf(_SC_PAGESIZE);
+  }
+
+  return info;
+}
+
+#endif
+
+
+void MemoryStats::beginStage(const string &name)
+{
+  endStage();
+
+  MutexLock lock(m_mutex);
+
+  Stage stage;
+  stage.name = name;
+  stage.peak = m_current;
+
+  m_stages.push_back(stage);
+  m_is_stage_active = true;
+}
+
+
+void MemoryStats::endStage()
+{
+  MutexLock lock(m_mutex);
+
+  if (!m_is_stage_active)
+    return;
+
+  m_stages.back().process_memory = getProcessMemoryInfo();
+  m_is_stage_active = false;
+}
+
+
+void MemoryStats::add(const string &type, size_t bytes)
+{
+  MutexLock lock(m_mutex);
+
+  m_current += bytes;
+  m_peak = max(m_peak, m_current);
+
+  if (m_is_stage_active)
+  {
+    auto &stage = m_stages.back();
+    stage.allocated_by_type[type] += bytes;
+    stage.allocated += bytes;
+    stage.peak = max(stage.peak, m_current);
+  }
+}
+
+
+void MemoryStats::remove(const string &type, size_t bytes)
+{
+  MutexLock lock(m_mutex);
+
+  assert(m_current >= bytes);
+  m_current -= min(m_current, bytes);
+}
+
+
+size_t MemoryStats::getCurrent()
+{
+  MutexLock lock(m_mutex);
+  return m_current;
+}
+
+
+size_t MemoryStats::getPeak()
+{
+  MutexLock lock(m_mutex);
+  return m_peak;
+}
+
+
+void MemoryStats::log()
+{
+  MutexLock lock(m_mutex);
+
+  for (auto &stage : m_stages)
+  {
+    LOG_INFO << "Stage " << stage.name << ": allocated " << formatSize(stage.allocated)
+             << ", peak " << formatSize(stage.peak)
+             << ", process: " << formatSize(stage.process_memory.current)
+             << " (peak " << formatSize(stage.process_memory.peak) << ")"
+             << ", address space: " << formatSize(stage.process_memory.address_space)
+             << endl;
+
+    for (auto &it : stage.allocated_by_type)
+      LOG_INFO << "  " << it.first << ": " << formatSize(it.second) << endl;
+  }
+
+  LOG_INFO << "Current: " << formatSize(m_current) << ", peak: " << formatSize(m_peak) << endl;
+}
+
+
+} // namespace il2ge
@@ -17,10 +17,18 @@
  */
 
 #include <il2ge/parameter_file.h>
-#include <util.h>
+#include <il2ge/thread_pool.h>
+#include <log.h>
 
 #include <glm/glm.hpp>
-#include <sstream>
+#include <string_view>
+#include <deque>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <cassert>
 
 using namespace std;
 
@@ -29,78 +37,142 @@ namespace
 {
 
 
-void stripComment(string &line)
+struct KeyTable
 {
-  static const std::vector<string> prefixes { "//" };
+  il2ge::Mutex mutex;
+  // views into names
+  unordered_map<string_view, int> ids;
+  // IDs index into this - deque keeps references valid
+  deque<string> names;
+};
 
-  for (auto &p : prefixes)
-  {
-    auto comment_start = line.find(p);
-    if (comment_start != string::npos)
-    {
-      line = move(line.substr(0, comment_start));
-      return;
-    }
-  }
+
+KeyTable &getKeyTable()
+{
+  static KeyTable table;
+  return table;
 }
 
+
+// same rules as std::stoi(), without throwing - token must be null-terminated
+bool parseInt(const char *token, int &value)
+{
+  char *end = nullptr;
+  errno = 0;
+  long res = strtol(token, &end, 10);
+
+  if (end == token || errno == ERANGE || res < INT_MIN || res > INT_MAX)
+    return false;
+
+  value = res;
+  return true;
+}
+
+
+// same rules as std::stof(), without throwing - token must be null-terminated
+bool parseFloat(const char *token, float &value)
+{
+  char *end = nullptr;
+  errno = 0;
+  float res = strtof(token, &end);
+
+  if (end == token || errno == ERANGE)
+    return false;
+
+  value = res;
+  return true;
+}
+
+
+bool isSpace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+// Single pass over the content, which must end with '\0'.
+// Tokens are null-terminated in place, so that they can be used without copying.
 template <class Section, class Handler>
-void readSectionFile(const char *content, size_t size, Handler &handler)
+void readSectionFile(vector<char> &content, Handler &handler)
 {
-  assert(content);
-  assert(size);
+  assert(!content.empty());
+  assert(content.back() == '\0');
+
+  // key and the values used by ParameterFile::Value
+  constexpr size_t MAX_TOKENS = 5;
 
-  stringstream in(string(content, size));
+  char *pos = content.data();
+  char *const end = content.data() + content.size() - 1;
 
   Section *section = nullptr;
 
-  while (in.good())
+  while (pos < end)
   {
-    string line;
-    getline(in, line);
+    auto line_end = static_cast<char*>(memchr(pos, '\n', end - pos));
+    if (!line_end)
+      line_end = end;
+
+    char *next_line = line_end < end ? line_end + 1 : end;
 
-    stripComment(line);
-    line = util::trim(line);
+    for (char *c = pos; c + 1 < line_end; c++)
+    {
+      if (c[0] == '/' && c[1] == '/')
+      {
+        line_end = c;
+        break;
+      }
+    }
 
-    if (line.empty())
+    while (pos < line_end && isSpace(*pos))
+      pos++;
+    while (line_end > pos && isSpace(line_end[-1]))
+      line_end--;
+
+    if (pos == line_end)
     {
-      continue;
+      // empty
     }
-    else if (line.front() == '[')
+    else if (*pos == '[')
     {
-      if (line.back() != ']')
+      if (line_end[-1] != ']')
       {
-        LOG_ERROR << "Unterminated section: " << line << endl;
+        LOG_ERROR << "Unterminated section: " << string_view(pos, line_end - pos) << endl;
         throw std::runtime_error("Unterminated section.");
       }
 
-      string section_name = line.substr(1, line.size()-2);
-      section = handler.getSection(section_name);
+      section = handler.getSection(string_view(pos + 1, line_end - pos - 2));
     }
     else
     {
       assert(section);
 
-      auto tokens = util::tokenize(line);
-      if (!tokens.empty())
+      string_view tokens[MAX_TOKENS];
+      size_t num_tokens = 0;
+
+      while (pos < line_end)
       {
-        vector<string> values;
-
-        for (auto &t : tokens)
-        {
-          string value = util::trim(t);
-          if (!value.empty())
-          {
-            if (util::isPrefix("//", value))
-              break;
-            values.push_back(move(value));
-          }
-        }
-
-        if (!values.empty())
-          handler.handleValues(section, move(values));
+        char *token = pos;
+        while (pos < line_end && !isSpace(*pos))
+          pos++;
+
+        if (num_tokens < MAX_TOKENS)
+          tokens[num_tokens] = string_view(token, pos - token);
+        num_tokens++;
+
+        // the line is done with this character - it's a separator, the line end
+        // or the terminating '\0'
+        *pos = '\0';
+        pos++;
+
+        while (pos < line_end && isSpace(*pos))
+          pos++;
       }
+
+      assert(num_tokens);
+      handler.handleValues(section, tokens, num_tokens);
     }
+
+    pos = next_line;
   }
 }
 
@@ -112,75 +184,196 @@ namespace il2ge
 {
 
 
-const std::string &ParameterFile::Section::at(const char *param) const
+ParameterFile::Key::Key(string_view name)
 {
-  return m_values.at(param).at(0);
+  auto &table = getKeyTable();
+  il2ge::MutexLock lock(table.mutex);
+
+  auto it = table.ids.find(name);
+  if (it != table.ids.end())
+  {
+    m_id = it->second;
+  }
+  else
+  {
+    m_id = table.names.size();
+    table.names.push_back(string(name));
+    table.ids[table.names.back()] = m_id;
+  }
 }
 
 
-void ParameterFile::Section::getImp(const char *name, glm::vec2 &value_) const
+const std::string &ParameterFile::Key::getName() const
 {
-  glm::vec4 value{0};
-  getImp(name, value);
-  value_ = glm::vec2(value.x, value.y);
+  il2ge::MutexLock lock(getKeyTable().mutex);
+  return getKeyTable().names.at(m_id);
 }
 
 
-void ParameterFile::Section::getImp(const char *name, glm::vec4 &value_) const
+ParameterFile::Value::Value(const string_view *tokens, size_t num_tokens) :
+  num_tokens(num_tokens)
 {
-  try
+  if (!num_tokens)
+    return;
+
+  text = tokens[0];
+  has_integer = parseInt(tokens[0].data(), integer);
+
+  size_t num_components = 0;
+  while (num_components < std::min<size_t>(num_tokens, 4) &&
+         parseFloat(tokens[num_components].data(), vec[num_components]))
+  {
+    num_components++;
+  }
+
+  if (num_components == 0)
+  {
+    type = Type::STRING;
+  }
+  else if (num_tokens > 1 && num_components == std::min<size_t>(num_tokens, 4))
   {
-    glm::vec4 value{0};
-
-    auto &tokens = m_values.at(name);
-
-//     try
-//     {
-      if (tokens.size() > 0)
-        value.x = std::stof(tokens.at(0));
-      if (tokens.size() > 1)
-        value.y = std::stof(tokens.at(1));
-      if (tokens.size() > 2)
-        value.z = std::stof(tokens.at(2));
-      if (tokens.size() > 3)
-        value.w = std::stof(tokens.at(3));
-//     }
-//     catch (...)
-//     {
-//       cout<<"stof"<<endl;
-//       abort();
-//     }
-
-    value_ = value;
+    type = Type::VECTOR;
   }
-  catch(std::out_of_range)
+  else
   {
-    cout<<"no such parameter: "<<name<<endl;
-    throw;
+    type = Type::SCALAR;
   }
 }
 
 
-ParameterFile::ParameterFile(const char *content, size_t size)
+bool ParameterFile::Value::convert(std::string &value) const
+{
+  if (!num_tokens)
+    return false;
+  value = text;
+  return true;
+}
+
+
+bool ParameterFile::Value::convert(int &value) const
+{
+  if (!has_integer)
+    return false;
+  value = integer;
+  return true;
+}
+
+
+bool ParameterFile::Value::convert(bool &value) const
+{
+  if (!has_integer)
+    return false;
+  value = integer;
+  return true;
+}
+
+
+bool ParameterFile::Value::convert(float &value) const
+{
+  if (!isNumeric())
+    return false;
+  value = vec.x;
+  return true;
+}
+
+
+bool ParameterFile::Value::convert(glm::vec4 &value) const
+{
+  // all components must be valid - no components means 0
+  if (type == Type::VECTOR || (type == Type::SCALAR && num_tokens == 1) || !num_tokens)
+  {
+    value = vec;
+    return true;
+  }
+  else
+  {
+    return false;
+  }
+}
+
+
+bool ParameterFile::Value::convert(glm::vec3 &value) const
+{
+  glm::vec4 v;
+  if (!convert(v))
+    return false;
+  value = glm::vec3(v.x, v.y, v.z);
+  return true;
+}
+
+
+bool ParameterFile::Value::convert(glm::vec2 &value) const
+{
+  glm::vec4 v;
+  if (!convert(v))
+    return false;
+  value = glm::vec2(v.x, v.y);
+  return true;
+}
+
+
+const ParameterFile::Value *ParameterFile::Section::find(Key key) const
+{
+  auto it = lower_bound(m_values.begin(), m_values.end(), key.getID(),
+                        [] (auto &entry, int id) { return entry.first < id; });
+
+  if (it != m_values.end() && it->first == key.getID())
+    return &it->second;
+  else
+    return nullptr;
+}
+
+
+void ParameterFile::Section::set(Key key, Value &&value)
+{
+  auto it = lower_bound(m_values.begin(), m_values.end(), key.getID(),
+                        [] (auto &entry, int id) { return entry.first < id; });
+
+  if (it != m_values.end() && it->first == key.getID())
+    it->second = move(value);
+  else
+    m_values.insert(it, { key.getID(), move(value) });
+}
+
+
+std::string_view ParameterFile::Section::at(const char *param) const
+{
+  auto value = find(param);
+  if (!value)
+    throw std::out_of_range(string("no such parameter: ") + param);
+  if (!value->num_tokens)
+    throw std::out_of_range(string("no value for parameter: ") + param);
+  return value->text;
+}
+
+
+ParameterFile::ParameterFile(const char *content, size_t size) :
+  ParameterFile(vector<char>(content, content + size))
+{
+}
+
+
+ParameterFile::ParameterFile(std::vector<char> &&content) : m_content(move(content))
 {
   struct Handler
   {
     ParameterFile *file = nullptr;
 
-    Section *getSection(const string &name) { return &file->m_sections[name]; }
+    Section *getSection(string_view name) { return &file->m_sections[string(name)]; }
 
-    void handleValues(Section *section, vector<string> &&values)
+    void handleValues(Section *section, const string_view *tokens, size_t num_tokens)
     {
-      auto key = values.front();
-      values.erase(values.begin());
-      section->m_values[key] = move(values);
+      section->set(tokens[0], Value(tokens + 1, num_tokens - 1));
     }
   };
 
+  assert(!m_content.empty());
+  m_content.push_back('\0');
+
   Handler handler;
   handler.file = this;
 
-  readSectionFile<Section>(content, size, handler);
+  readSectionFile<Section>(m_content, handler);
 }
 
 
@@ -199,7 +392,7 @@ const ParameterFile &ParameterFiles::get(const string &file_path)
 
     try
     {
-      file = make_unique<ParameterFile>(content.data(), content.size());
+      file = make_unique<ParameterFile>(move(content));
     }
     catch(...)
     {
@@ -0,0 +1,355 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <il2ge/thread_pool.h>
+
+#include <deque>
+#include <vector>
+#include <exception>
+#include <cassert>
+
+#if IL2GE_NO_STD_THREAD
+#include <windows.h>
+#else
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#endif
+
+using namespace std;
+
+
+namespace
+{
+
+
+#if IL2GE_NO_STD_THREAD
+
+class Lock
+{
+  CRITICAL_SECTION m_cs;
+
+public:
+  Lock() { InitializeCriticalSection(&m_cs); }
+  ~Lock() { DeleteCriticalSection(&m_cs); }
+
+  void lock() { EnterCriticalSection(&m_cs); }
+  void unlock() { LeaveCriticalSection(&m_cs); }
+
+  CRITICAL_SECTION *get() { return &m_cs; }
+};
+
+
+class ConditionVariable
+{
+  CONDITION_VARIABLE m_cv;
+
+public:
+  ConditionVariable() { InitializeConditionVariable(&m_cv); }
+
+  void wait(Lock &lock) { SleepConditionVariableCS(&m_cv, lock.get(), INFINITE); }
+  void waitFor(Lock &lock, int ms) { SleepConditionVariableCS(&m_cv, lock.get(), ms); }
+  void notifyOne() { WakeConditionVariable(&m_cv); }
+  void notifyAll() { WakeAllConditionVariable(&m_cv); }
+};
+
+
+class Thread
+{
+  HANDLE m_handle = 0;
+  std::function<void()> m_func;
+
+  static DWORD WINAPI run(void *arg)
+  {
+    static_cast<Thread*>(arg)->m_func();
+    return 0;
+  }
+
+public:
+  Thread(std::function<void()> func) : m_func(func)
+  {
+    m_handle = CreateThread(nullptr, 0, &run, this, 0, nullptr);
+    assert(m_handle);
+  }
+
+  ~Thread()
+  {
+    WaitForSingleObject(m_handle, INFINITE);
+    CloseHandle(m_handle);
+  }
+};
+
+
+int getNumCPUsImp()
+{
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors;
+}
+
+#else
+
+class Lock
+{
+  std::mutex m_mutex;
+
+public:
+  void lock() { m_mutex.lock(); }
+  void unlock() { m_mutex.unlock(); }
+};
+
+
+class ConditionVariable
+{
+  std::condition_variable_any m_cv;
+
+public:
+  void wait(Lock &lock) { m_cv.wait(lock); }
+  void waitFor(Lock &lock, int ms) { m_cv.wait_for(lock, std::chrono::milliseconds(ms)); }
+  void notifyOne() { m_cv.notify_one(); }
+  void notifyAll() { m_cv.notify_all(); }
+};
+
+
+class Thread
+{
+  std::thread m_thread;
+
+public:
+  Thread(std::function<void()> func) : m_thread(func) {}
+
+  ~Thread()
+  {
+    m_thread.join();
+  }
+};
+
+
+int getNumCPUsImp()
+{
+  return std::thread::hardware_concurrency();
+}
+
+#endif
+
+
+class ScopedLock
+{
+  Lock &m_lock;
+
+public:
+  ScopedLock(Lock &lock) : m_lock(lock) { m_lock.lock(); }
+  ~ScopedLock() { m_lock.unlock(); }
+};
+
+
+} // namespace
+
+
+namespace il2ge
+{
+
+
+struct ThreadPool::Private
+{
+  Lock lock;
+  ConditionVariable job_available;
+  ConditionVariable jobs_done;
+  deque<Job> jobs;
+  int num_unfinished_jobs = 0;
+  bool quit = false;
+  exception_ptr error;
+  vector<unique_ptr<Thread>> threads;
+
+  void work()
+  {
+    while (true)
+    {
+      Job job;
+
+      {
+        ScopedLock l(lock);
+
+        while (jobs.empty() && !quit)
+          job_available.wait(lock);
+
+        if (jobs.empty())
+          return;
+
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }
+
+      exception_ptr job_error;
+
+      try
+      {
+        job();
+      }
+      catch (...)
+      {
+        job_error = current_exception();
+      }
+
+      {
+        ScopedLock l(lock);
+
+        if (job_error && !error)
+          error = job_error;
+
+        assert(num_unfinished_jobs > 0);
+        num_unfinished_jobs--;
+        if (!num_unfinished_jobs)
+          jobs_done.notifyAll();
+      }
+    }
+  }
+};
+
+
+ThreadPool::ThreadPool(int num_threads) : p(new Private)
+{
+  if (num_threads <= 0)
+    num_threads = getNumCPUs();
+
+  for (int i = 0; i < num_threads; i++)
+    p->threads.push_back(make_unique<Thread>([this] { p->work(); }));
+}
+
+
+ThreadPool::~ThreadPool()
+{
+  {
+    ScopedLock l(p->lock);
+    p->quit = true;
+    p->job_available.notifyAll();
+  }
+
+  // joins the threads
+  p->threads.clear();
+}
+
+
+int ThreadPool::getNumThreads() const
+{
+  return p->threads.size();
+}
+
+
+void ThreadPool::submit(Job job)
+{
+  ScopedLock l(p->lock);
+  assert(!p->quit);
+  p->jobs.push_back(std::move(job));
+  p->num_unfinished_jobs++;
+  p->job_available.notifyOne();
+}
+
+
+void ThreadPool::wait()
+{
+  exception_ptr error;
+
+  {
+    ScopedLock l(p->lock);
+
+    while (p->num_unfinished_jobs)
+      p->jobs_done.wait(p->lock);
+
+    swap(error, p->error);
+  }
+
+  if (error)
+    rethrow_exception(error);
+}
+
+
+bool ThreadPool::waitFor(int milliseconds)
+{
+  exception_ptr error;
+
+  {
+    ScopedLock l(p->lock);
+
+    if (p->num_unfinished_jobs)
+      p->jobs_done.waitFor(p->lock, milliseconds);
+
+    if (p->num_unfinished_jobs)
+      return false;
+
+    swap(error, p->error);
+  }
+
+  if (error)
+    rethrow_exception(error);
+
+  return true;
+}
+
+
+int ThreadPool::getNumCPUs()
+{
+  int num_cpus = getNumCPUsImp();
+  return num_cpus > 0 ? num_cpus : 1;
+}
+
+
+struct Mutex::Private
+{
+  Lock lock;
+};
+
+
+Mutex::Mutex() : p(new Private) {}
+
+Mutex::~Mutex() {}
+
+void Mutex::lock()
+{
+  p->lock.lock();
+}
+
+void Mutex::unlock()
+{
+  p->lock.unlock();
+}
+
+
+struct Condition::Private
+{
+  ConditionVariable cv;
+};
+
+
+Condition::Condition() : p(new Private) {}
+
+Condition::~Condition() {}
+
+void Condition::wait(Mutex &mutex)
+{
+  p->cv.wait(mutex.p->lock);
+}
+
+void Condition::notifyAll()
+{
+  p->cv.notifyAll();
+}
+
+
+} // namespace il2ge
@@ -0,0 +1,82 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "baked_map_cache.h"
+#include "ressource_loader.h"
+#include <sfs.h>
+#include <util.h>
+
+#include <cstdint>
+#include <cassert>
+
+using namespace std;
+
+
+namespace
+{
+  const string g_baked_map_dir = IL2GE_CACHE_DIR "/maps";
+}
+
+
+string core::getBakedMapPath(const string &ini_path)
+{
+  union
+  {
+    __int64 as_signed;
+    uint64_t as_unsigned;
+  } sfs_hash;
+
+  sfs_hash.as_signed = sfs::getHash(ini_path.c_str());
+
+  return g_baked_map_dir + '/' + to_string(sfs_hash.as_unsigned) + ".bin";
+}
+
+
+string core::getBakedMapKey(core::RessourceLoader &loader)
+{
+  string key = "load.ini " + loader.getIniFileKey() + '\n';
+
+  for (auto &file : il2ge::map_loader::getBakedMapInputFiles())
+  {
+    key += string(file.section) + '/' + file.name;
+    if (file.suffix)
+      key += file.suffix;
+    key += ' ';
+
+    if (file.is_texture)
+      key += loader.getTextureFileKey(file.section, file.name, file.default_path, file.from_map_dir);
+    else
+      key += loader.getFileKey(file.section, file.name, file.default_path, file.suffix);
+
+    key += '\n';
+  }
+
+  return key;
+}
+
+
+bool core::saveBakedMapToCache(const string &path, const string &key,
+                               const il2ge::map_loader::BakedMap &baked_map)
+{
+  auto res = util::mkdir(IL2GE_CACHE_DIR);
+  assert(res);
+  res = util::mkdir(g_baked_map_dir.c_str());
+  assert(res);
+
+  return il2ge::map_loader::saveBakedMap(path, key, baked_map);
+}
@@ -0,0 +1,40 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORE_BAKED_MAP_CACHE_H
+#define CORE_BAKED_MAP_CACHE_H
+
+#include <il2ge/map_loader.h>
+
+#include <string>
+
+namespace core
+{
+  class RessourceLoader;
+
+  // Location and key of the il2ge::map_loader::BakedMap cache -
+  // shared by the game and the offline cache baker.
+  std::string getBakedMapPath(const std::string &ini_path);
+  std::string getBakedMapKey(RessourceLoader&);
+
+  // creates the cache directory if necessary
+  bool saveBakedMapToCache(const std::string &path, const std::string &key,
+                           const il2ge::map_loader::BakedMap&);
+}
+
+#endif
@@ -23,6 +23,7 @@
 #include <core/scene.h>
 #include <wgl_wrapper.h>
 #include <misc.h>
+#include <sfs.h>
 #include <jni.h>
 #include <il2ge/map_loader.h>
 
@@ -32,6 +33,7 @@
 
 #include <INIReader.h>
 #include <functional>
+#include <algorithm>
 #include <iostream>
 #include <cassert>
 #include <sys/types.h>
@@ -152,6 +154,9 @@ Menu &getMenu()
 
 void init()
 {
+  auto sfs_cache_size_mb = std::max(0, il2ge::core_wrapper::getConfig().sfs_cache_size.get());
+  sfs::setCacheBudget(size_t(sfs_cache_size_mb) * 1024 * 1024);
+
 #ifndef NO_REFRESH_MAPS
   auto res = util::mkdir(IL2GE_CACHE_DIR);
   assert(res);
@@ -18,6 +18,7 @@
 
 #include "map.h"
 #include "ressource_loader.h"
+#include "baked_map_cache.h"
 #include "core_p.h"
 
 #include <sfs.h>
@@ -32,6 +33,8 @@
 #include <render_util/water.h>
 #include <render_util/atmosphere.h>
 #include <il2ge/map_loader.h>
+#include <il2ge/thread_pool.h>
+#include <il2ge/memory_stats.h>
 
 #include <GL/gl.h>
 #include <GL/glext.h>
@@ -48,6 +51,66 @@ namespace
 {
   const bool g_terrain_use_lod = true;
   const string dump_base_dir = "il2ge_dump/"; //HACK
+
+
+  class LoadingProgress
+  {
+    il2ge::Mutex m_mutex;
+    float m_percent = 0;
+    string m_description;
+    bool m_changed = false;
+
+  public:
+    void set(float percent, const string &description)
+    {
+      il2ge::MutexLock lock(m_mutex);
+      m_percent = percent;
+      m_description = description;
+      m_changed = true;
+    }
+
+    bool get(float &percent, string &description)
+    {
+      il2ge::MutexLock lock(m_mutex);
+      if (!m_changed)
+        return false;
+      percent = m_percent;
+      description = m_description;
+      m_changed = false;
+      return true;
+    }
+
+    map_loader::ProgressFunc getStage(float begin, float end)
+    {
+      return [this, begin, end] (float fraction, const string &description)
+      {
+        set(begin + (end - begin) * fraction, description);
+      };
+    }
+  };
+
+
+  // Runs func on a worker thread while the calling (JNI) thread keeps forwarding progress.
+  void runLoadingThread(core::ProgressReporter *progress,
+                        std::function<void(LoadingProgress&)> func)
+  {
+    LoadingProgress loading_progress;
+    il2ge::ThreadPool thread(1);
+
+    thread.submit([&] { func(loading_progress); });
+
+    float percent = 0;
+    string description;
+
+    while (!thread.waitFor(50))
+    {
+      if (loading_progress.get(percent, description))
+        progress->report(percent, description);
+    }
+
+    if (loading_progress.get(percent, description))
+      progress->report(percent, description);
+  }
 }
 
 
@@ -89,6 +152,7 @@ Map::Map(const char *path, ProgressReporter *progress,
 {
   const bool enable_base_map = false;//il2ge::core_wrapper::getConfig().enable_base_map;
   const bool enable_normal_maps = il2ge::core_wrapper::getConfig().enable_bumph_maps;
+  const bool low_memory = il2ge::core_wrapper::getConfig().low_memory_map_loading;
 
   FORCE_CHECK_GL_ERROR();
 
@@ -121,7 +185,7 @@ Map::Map(const char *path, ProgressReporter *progress,
   map_dir = string("maps/") + map_dir;
   ini_path = string("maps/") + path;
 
-  RessourceLoader res_loader(map_dir, ini_path, dump_dir);
+  RessourceLoader res_loader(map_dir, ini_path, dump_dir, low_memory);
 
   render_util::ElevationMap::Ptr elevation_map_base;
   ImageGreyScale::Ptr land_map;
@@ -163,18 +227,126 @@ Map::Map(const char *path, ProgressReporter *progress,
 #endif
 
 
-  p->pixel_map_h = map_loader::createPixelMapH(&res_loader);
+  // the dump needs the input files, so don't use the cache then
+  const bool use_baked_map_cache = !il2ge::map_loader::isDumpEnabled();
+
+  map_loader::BakedMap baked_map;
+  map_loader::MapTextureImages map_texture_images;
+  LandTextures land_textures;
+  string baked_map_path;
+  string baked_map_key;
+  bool is_baked_map_cached = false;
+
+  MemoryStats memory_stats;
+
+  auto add_images = [&memory_stats] (auto &images)
+  {
+    map_loader::visitImages(images, [&memory_stats] (const char *type, size_t size)
+    {
+      memory_stats.add(type, size);
+    });
+  };
+
+  auto remove_images = [&memory_stats] (auto &images)
+  {
+    map_loader::visitImages(images, [&memory_stats] (const char *type, size_t size)
+    {
+      memory_stats.remove(type, size);
+    });
+  };
+
+  auto load_land_textures = [&] (LoadingProgress &loading_progress)
+  {
+    memory_stats.beginStage("land textures");
+
+    map_loader::createLandTextures(&res_loader, baked_map, land_textures, enable_normal_maps,
+                                   loading_progress.getStage(4, 7), &memory_stats, low_memory);
+
+    if (use_baked_map_cache && !is_baked_map_cached)
+    {
+      if (!saveBakedMapToCache(baked_map_path, baked_map_key, baked_map))
+        LOG_WARNING << "Failed to write " << baked_map_path << endl;
+    }
+
+    memory_stats.endStage();
+  };
+
+  // CPU phase - everything that doesn't need GL runs on the loading thread.
+  // SFS and res_loader are only used from there while this thread is waiting.
+  runLoadingThread(progress, [&] (LoadingProgress &loading_progress)
+  {
+    memory_stats.beginStage("baked map");
+
+    loading_progress.set(1, "Loading map");
+
+    if (use_baked_map_cache)
+    {
+      baked_map_path = getBakedMapPath(ini_path);
+      baked_map_key = getBakedMapKey(res_loader);
+      is_baked_map_cached = map_loader::loadBakedMap(baked_map_path, baked_map_key, baked_map);
+    }
+
+    if (!is_baked_map_cached)
+      map_loader::bakeMap(&res_loader, baked_map, loading_progress.getStage(1, 3));
+
+    add_images(baked_map);
+
+    memory_stats.beginStage("map textures");
+
+    map_loader::loadMapTextureImages(&res_loader, map_texture_images,
+                                     loading_progress.getStage(3, 4));
+
+    add_images(map_texture_images);
+
+    memory_stats.endStage();
+
+    // in low memory mode the map textures are uploaded and freed first
+    if (!low_memory)
+      load_land_textures(loading_progress);
+  });
+
+  // GL phase
+
+  p->pixel_map_h = baked_map.pixel_map_h;
 
   assert(p->pixel_map_h);
 
-  auto elevation_map = map_loader::createElevationMap(p->pixel_map_h);
+  auto elevation_map = baked_map.elevation_map;
   p->size = glm::vec2(elevation_map->getSize() * (int)il2ge::HEIGHT_MAP_METERS_PER_PIXEL);
 
-  progress->report(3, "Creating textures");
+  progress->report(low_memory ? 4 : 7, "Uploading textures");
 
-  auto type_map = map_loader::createTypeMap(&res_loader);
+  memory_stats.beginStage("upload");
 
-  map_loader::createMapTextures(&res_loader, type_map, p);
+  map_loader::createMapTextures(baked_map, map_texture_images, p);
+
+  // uploaded
+  remove_images(map_texture_images);
+  map_texture_images = {};
+
+  if (low_memory)
+  {
+    memory_stats.endStage();
+    runLoadingThread(progress, load_land_textures);
+    memory_stats.beginStage("upload land textures");
+  }
+
+  {
+    // everything but what the terrain still needs has been uploaded and the cache is written
+    map_loader::BakedMap uploaded;
+    uploaded.water_type_map = baked_map.water_type_map;
+    uploaded.forest_map = baked_map.forest_map;
+    uploaded.water_map_chunks = baked_map.water_map_chunks;
+    uploaded.water_map_table = baked_map.water_map_table;
+    uploaded.type_map = baked_map.type_map;
+    remove_images(uploaded);
+
+    baked_map.water_type_map.reset();
+    baked_map.forest_map.reset();
+    baked_map.water_map_chunks.clear();
+    baked_map.water_map_table.reset();
+    baked_map.type_map.reset();
+  }
 
 #if 0
   if (land_map)
@@ -202,12 +374,16 @@ Map::Map(const char *path, ProgressReporter *progress,
 
   FORCE_CHECK_GL_ERROR();
 
-
-  LandTextures land_textures;
-  map_loader::createLandTextures(&res_loader, type_map, land_textures, enable_normal_maps);
-
   p->textures->setTexture(TEXUNIT_TERRAIN_FAR, land_textures.far_texture);
 
+  {
+    map_loader::BakedMap uploaded;
+    uploaded.far_texture = baked_map.far_texture;
+    remove_images(uploaded);
+    baked_map.far_texture.reset();
+    land_textures.far_texture.reset();
+  }
+
   p->textures->bind(core::textureManager());
 
   assert(p->material_map);
@@ -216,20 +392,38 @@ Map::Map(const char *path, ProgressReporter *progress,
 
   FORCE_CHECK_GL_ERROR();
 
-  progress->report(7, "Creating terrain");
+  memory_stats.beginStage("terrain");
+
+  progress->report(8, "Creating terrain");
 
-  render_util::TerrainBase::BuildParameters params =
   {
-    .map = elevation_map,
-    .material_map = p->material_map,
-    .type_map = land_textures.type_map,
-    .textures = land_textures.textures,
-    .textures_nm = land_textures.textures_nm,
-    .texture_scale = land_textures.texture_scale,
-    .shader_parameters = shader_params,
-  };
+    render_util::TerrainBase::BuildParameters params =
+    {
+      .map = elevation_map,
+      .material_map = p->material_map,
+      .type_map = land_textures.type_map,
+      .textures = land_textures.textures,
+      .textures_nm = land_textures.textures_nm,
+      .texture_scale = land_textures.texture_scale,
+      .shader_parameters = shader_params,
+    };
+
+    p->terrain->build(params);
+  }
+
+  {
+    // uploaded by the terrain
+    remove_images(land_textures);
+    land_textures = {};
+
+    map_loader::BakedMap uploaded;
+    uploaded.land_type_map = baked_map.land_type_map;
+    remove_images(uploaded);
+    baked_map.land_type_map.reset();
+  }
 
-  p->terrain->build(params);
+  memory_stats.endStage();
+  memory_stats.log();
 
 #if 0
   if (elevation_map_base)
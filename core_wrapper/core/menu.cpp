@@ -19,6 +19,7 @@
 #include "menu.h"
 #include "core_p.h"
 #include <keys.h>
+#include <sfs.h>
 #include <core/scene.h>
 #include <render_util/quad_2d.h>
 #include <render_util/gl_binding/gl_functions.h>
@@ -97,6 +98,19 @@ void Menu::rebuild()
 
   m_display.addLine();
 
+  auto cache_stats = sfs::getCacheStats();
+  if (cache_stats.budget)
+  {
+    char buf[200];
+    snprintf(buf, sizeof(buf), "SFS cache: %u hits, %u misses, %u files, %u / %u MB",
+             unsigned(cache_stats.hits), unsigned(cache_stats.misses),
+             unsigned(cache_stats.num_entries),
+             unsigned(cache_stats.size / (1024 * 1024)),
+             unsigned(cache_stats.budget / (1024 * 1024)));
+    m_display.addLine(buf, glm::vec3(0.6));
+    m_display.addLine();
+  }
+
   for (int i = 0; i < m_scene.getNumParameters(); i++)
   {
     auto &param = m_scene.getParameter(i);
@@ -0,0 +1,352 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "normal_map_baker.h"
+#include <sfs.h>
+#include <il2ge/map_loader.h>
+#include <il2ge/image_loader.h>
+#include <util.h>
+#include <log.h>
+#include <render_util/image_util.h>
+#include <render_util/texture_util.h>
+
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <cassert>
+#include <stdexcept>
+
+using namespace std;
+using Clock = std::chrono::steady_clock;
+
+
+namespace
+{
+
+
+// baked but not yet handed over normal maps beyond this are only kept on disk
+constexpr size_t MAX_PENDING_SIZE = 64 * 1024 * 1024;
+constexpr size_t MAX_PENDING_SIZE_LOW_MEMORY = 0;
+
+
+// empty if the .BumpH file doesn't exist
+string getCachePath(const string &bumph_path, float scale)
+{
+  long size = 0;
+  if (!sfs::getFileSize(bumph_path, size))
+    return {};
+
+  union
+  {
+    __int64 as_signed;
+    uint64_t as_unsigned;
+  } sfs_hash;
+
+  sfs_hash.as_signed = sfs::getHash(bumph_path.c_str());
+
+  return string(IL2GE_CACHE_DIR "/bumph/") + to_string(sfs_hash.as_unsigned) + "_" +
+    to_string(size) + "_" + to_string(scale) + ".nm";
+}
+
+
+// The cache and pending results only hold X and Y, see decodeNormalMap().
+vector<char> encodeNormalMap(const render_util::ImageRGB &normal_map)
+{
+  const size_t num_pixels = size_t(normal_map.w()) * normal_map.h();
+  auto src = normal_map.getData();
+
+  vector<unsigned char> xy(num_pixels * 2);
+  for (size_t i = 0; i < num_pixels; i++)
+  {
+    xy[i*2+0] = src[i*3+0];
+    xy[i*2+1] = src[i*3+1];
+  }
+
+  return il2ge::encodeRawImage(xy.data(), normal_map.getSize(), 2);
+}
+
+
+// Reconstructs Z - rounding of X and Y makes it differ by up to 2 from the baked value.
+// RGB cache files (from before) are left as they are.
+bool decodeNormalMap(vector<char> &content, const string &name)
+{
+  il2ge::ImageInfo info;
+  if (!il2ge::probeImage(content, info) || info.format != il2ge::ImageFormat::RAW)
+  {
+    LOG_ERROR << name << ": invalid normal map" << endl;
+    return false;
+  }
+
+  if (info.num_channels == 3)
+    return true;
+
+  const size_t num_pixels = size_t(info.size.x) * info.size.y;
+
+  vector<unsigned char> xy(num_pixels * 2);
+  il2ge::DecodeOptions options;
+  options.num_channels = 2;
+
+  if (info.num_channels != 2 || !il2ge::decodeImage(content, xy.data(), xy.size(), options, name.c_str()))
+  {
+    LOG_ERROR << name << ": invalid normal map" << endl;
+    return false;
+  }
+
+  vector<unsigned char> rgb(num_pixels * 3);
+  for (size_t i = 0; i < num_pixels; i++)
+  {
+    float x = xy[i*2+0] / 255.f * 2 - 1;
+    float y = xy[i*2+1] / 255.f * 2 - 1;
+    float z = sqrt(max(0.f, 1 - x * x - y * y));
+
+    rgb[i*3+0] = xy[i*2+0];
+    rgb[i*3+1] = xy[i*2+1];
+    rgb[i*3+2] = lround((z * 0.5f + 0.5f) * 255);
+  }
+
+  content = il2ge::encodeRawImage(rgb.data(), info.size, 3);
+
+  return !content.empty();
+}
+
+
+bool isCached(const string &cache_path)
+{
+  ifstream in(cache_path, ios_base::binary);
+  return in.good();
+}
+
+
+bool saveToCache(const string &cache_path, const vector<char> &content)
+{
+  auto res = util::mkdir(IL2GE_CACHE_DIR);
+  assert(res);
+  res = util::mkdir(IL2GE_CACHE_DIR "/bumph");
+  assert(res);
+
+  // written under a temporary name, so that a partial file is never picked up
+  auto tmp_path = cache_path + ".tmp";
+
+  if (!util::writeFile(tmp_path, content.data(), content.size()))
+  {
+    LOG_ERROR << "Failed to write " << tmp_path << endl;
+    return false;
+  }
+
+  remove(cache_path.c_str());
+  if (rename(tmp_path.c_str(), cache_path.c_str()) != 0)
+  {
+    LOG_ERROR << "Failed to rename " << tmp_path << " -> " << cache_path << endl;
+    return false;
+  }
+
+  return true;
+}
+
+
+} // namespace
+
+
+struct core::NormalMapBaker::Job
+{
+  string bumph_path;
+  string cache_path;
+  float scale = 1;
+  vector<char> source;
+  vector<char> result;
+  // done and the result are protected by NormalMapBaker::m_mutex
+  bool done = false;
+  bool success = false;
+  il2ge::Condition done_condition;
+};
+
+
+core::NormalMapBaker::NormalMapBaker(bool low_memory) : m_low_memory(low_memory)
+{
+}
+
+
+core::NormalMapBaker::~NormalMapBaker()
+{
+  if (m_pool)
+    m_pool->wait();
+}
+
+
+void core::NormalMapBaker::bake(Job &job)
+{
+  vector<char> result;
+  bool is_saved = false;
+
+  auto start_time = Clock::now();
+
+  try
+  {
+    auto image = il2ge::loadImageFromMemory(job.source, job.bumph_path.c_str());
+    if (image)
+    {
+      auto heightmap = render_util::image::getChannel(image, 0);
+      auto normal_map = render_util::createNormalMap(heightmap, 5.0,
+                                                     job.scale * il2ge::TERRAIN_METERS_PER_TEXTURE_TILE);
+      result = encodeNormalMap(*normal_map);
+      if (!result.empty())
+        is_saved = saveToCache(job.cache_path, result);
+
+      auto ms = chrono::duration_cast<chrono::milliseconds>(Clock::now() - start_time).count();
+      LOG_INFO << "baked " << job.bumph_path << " in " << ms << " ms" << endl;
+    }
+    else
+    {
+      LOG_ERROR << job.bumph_path << ": loadImageFromMemory() failed" << endl;
+    }
+  }
+  catch (std::exception &e)
+  {
+    LOG_ERROR << "Failed to bake " << job.bumph_path << ": " << e.what() << endl;
+    result.clear();
+  }
+
+  il2ge::MutexLock lock(m_mutex);
+
+  job.source = {};
+  job.success = !result.empty();
+  job.done = true;
+  job.done_condition.notifyAll();
+
+  const size_t max_pending_size = m_low_memory ? MAX_PENDING_SIZE_LOW_MEMORY : MAX_PENDING_SIZE;
+
+  // get() falls back to the cache file - unless it couldn't be written
+  if (!is_saved || m_pending_size + result.size() <= max_pending_size)
+  {
+    m_pending_size += result.size();
+    job.result = std::move(result);
+  }
+}
+
+
+void core::NormalMapBaker::submit(const string &bumph_path, float scale)
+{
+  auto cache_path = getCachePath(bumph_path, scale);
+  if (cache_path.empty() || m_jobs.count(cache_path) || isCached(cache_path))
+    return;
+
+  auto job = make_shared<Job>();
+  job->bumph_path = bumph_path;
+  job->cache_path = cache_path;
+  job->scale = scale;
+
+  // SFS is only accessed from this thread
+  if (!sfs::readFile(bumph_path, job->source))
+  {
+    LOG_WARNING << bumph_path << " not found" << endl;
+    return;
+  }
+
+  // the map loader decodes the field textures on all cores at the same time
+  if (!m_pool)
+  {
+    int num_threads = m_low_memory ? 1 : max(1, il2ge::ThreadPool::getNumCPUs() / 2);
+    m_pool = make_unique<il2ge::ThreadPool>(num_threads);
+  }
+
+  m_jobs[cache_path] = job;
+
+  m_pool->submit([this, job] { bake(*job); });
+}
+
+
+void core::NormalMapBaker::wait(Job &job)
+{
+  il2ge::MutexLock lock(m_mutex);
+  while (!job.done)
+    job.done_condition.wait(m_mutex);
+}
+
+
+bool core::NormalMapBaker::takeResult(Job &job, vector<char> &content)
+{
+  bool is_pending = false;
+
+  {
+    il2ge::MutexLock lock(m_mutex);
+
+    assert(job.done);
+    if (!job.success)
+      return false;
+
+    if (!job.result.empty())
+    {
+      m_pending_size -= job.result.size();
+      content = std::move(job.result);
+      is_pending = true;
+    }
+  }
+
+  if (!is_pending && !util::readFile(job.cache_path, content, true))
+    return false;
+
+  return decodeNormalMap(content, job.bumph_path);
+}
+
+
+bool core::NormalMapBaker::get(const string &bumph_path, float scale, vector<char> &content)
+{
+  auto cache_path = getCachePath(bumph_path, scale);
+  if (cache_path.empty())
+  {
+    LOG_WARNING << bumph_path << " not found" << endl;
+    return false;
+  }
+
+  shared_ptr<Job> job;
+
+  auto it = m_jobs.find(cache_path);
+  if (it != m_jobs.end())
+  {
+    job = it->second;
+    m_jobs.erase(it);
+  }
+
+  if (job)
+  {
+    wait(*job);
+    return takeResult(*job, content);
+  }
+
+  if (util::readFile(cache_path, content, true) && decodeNormalMap(content, cache_path))
+    return true;
+
+  // not submitted - bake in this thread
+  job = make_shared<Job>();
+  job->bumph_path = bumph_path;
+  job->cache_path = cache_path;
+  job->scale = scale;
+
+  if (!sfs::readFile(bumph_path, job->source))
+  {
+    LOG_WARNING << bumph_path << " not found" << endl;
+    return false;
+  }
+
+  bake(*job);
+
+  return takeResult(*job, content);
+}
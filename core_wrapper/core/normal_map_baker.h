@@ -0,0 +1,70 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORE_NORMAL_MAP_BAKER_H
+#define CORE_NORMAL_MAP_BAKER_H
+
+#include <il2ge/thread_pool.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+namespace core
+{
+
+
+  // Bakes .BumpH height maps into normal maps on a worker pool.
+  // Baked normal maps are cached on disk - keyed on the SFS hash and size of the .BumpH file
+  // and the scale - and handed over in memory. Both only store X and Y as a two channel
+  // il2ge::encodeRawImage(), Z is reconstructed by get().
+  // All methods must be called from the same thread.
+  class NormalMapBaker
+  {
+    struct Job;
+
+    // protects the jobs' results and m_pending_size
+    il2ge::Mutex m_mutex;
+    // only accessed by the calling thread
+    std::unordered_map<std::string, std::shared_ptr<Job>> m_jobs;
+    size_t m_pending_size = 0;
+    const bool m_low_memory = false;
+    std::unique_ptr<il2ge::ThreadPool> m_pool;
+
+    void bake(Job&);
+    void wait(Job&);
+    bool takeResult(Job&, std::vector<char> &content);
+
+  public:
+    // low_memory: bake on a single thread and hand over results through the cache files only
+    NormalMapBaker(bool low_memory = false);
+    ~NormalMapBaker();
+
+    // Starts baking in the background, unless the normal map is cached already.
+    void submit(const std::string &bumph_path, float scale);
+
+    // Waits for a submitted job - otherwise reads the cache or bakes in the calling thread.
+    // content is an RGB image in a format supported by il2ge::decodeImage().
+    bool get(const std::string &bumph_path, float scale, std::vector<char> &content);
+  };
+
+
+}
+
+#endif
@@ -19,11 +19,8 @@
 #include "ressource_loader.h"
 #include "sfs.h"
 #include <il2ge/map_loader.h>
-#include <il2ge/image_loader.h>
 #include <util.h>
-#include <render_util/image_util.h>
-#include <render_util/image_loader.h>
-#include <render_util/texture_util.h>
+#include <log.h>
 
 #include <cassert>
 #include <iostream>
@@ -53,82 +50,63 @@ namespace
   }
 
 
-  bool readTextureFile(string dir, string filename_base, string ext,
-                      bool redirect, std::vector<char> &content)
+  // size < 0: the file doesn't exist
+  string getFileKey(__int64 hash, long size)
   {
-    string path = dir + filename_base + ext;
+    union
+    {
+      __int64 as_signed;
+      uint64_t as_unsigned;
+    } sfs_hash;
 
-    bool was_read = sfs::readFile(path, content);
+    sfs_hash.as_signed = hash;
 
-    if (was_read && redirect)
-      sfs::redirect(sfs::getHash(path.c_str()), sfs::getHash("il2ge/dummy.tga"));
+    string key = to_string(sfs_hash.as_unsigned) + ':';
 
-    return was_read;
+    if (size >= 0)
+      key += to_string(size);
+    else
+      key += "none";
+
+    return key;
   }
 
 
-  void cacheNormalMap(string bumph_path, string cache_path, float scale)
+  string getFileKey(const string &path)
   {
-    cout<<"cacheNormalMap: "<<bumph_path<<endl;
+    long size = 0;
+    if (!sfs::getFileSize(path, size))
+      size = -1;
 
-    std::vector<char> content;
-    if (sfs::readFile(bumph_path, content))
-    {
-      auto image = il2ge::loadImageFromMemory(content, bumph_path.c_str());
-      if (image)
-      {
-        auto heightmap = render_util::image::getChannel(image, 0);
-
-        auto normal_map = render_util::createNormalMap(heightmap, 5.0,
-                                                       scale * il2ge::TERRAIN_METERS_PER_TEXTURE_TILE);
-        cout<<"caching "<<bumph_path<<" -> "<<cache_path<<endl;
-        render_util::saveImageToFile(cache_path, normal_map.get());
-      }
-      else
-      {
-        cout<<bumph_path<<": loadImageFromMemory() failed"<<endl;
-      }
-    }
-    else
-    {
-      cout<<bumph_path<<" not found"<<endl;
-    }
+    return getFileKey(sfs::getHash(path.c_str()), size);
   }
 
 
-  bool readNormalMapFile(string dir, string filename_base,
-                      bool redirect, float scale, std::vector<char> &content)
+  __int64 getDummyTextureHash()
   {
-    string bumph_path = dir + filename_base + ".BumpH";
-
-    cout<<"readNormalMapFile: "<<bumph_path<<endl;
+    static const __int64 hash = sfs::getHash("il2ge/dummy.tga");
+    return hash;
+  }
 
-    union
-    {
-      __int64 as_signed;
-      uint64_t as_unsigned;
-    } sfs_hash;
 
-    sfs_hash.as_signed = sfs::getHash(bumph_path.c_str());
+  __int64 getNullHash()
+  {
+    static const __int64 hash = sfs::getHash("NULL");
+    return hash;
+  }
 
-    auto res = util::mkdir(IL2GE_CACHE_DIR);
-    assert(res);
-    res = util::mkdir(IL2GE_CACHE_DIR "/bumph");
-    assert(res);
 
-    auto cache_path = string(IL2GE_CACHE_DIR "/bumph/") +
-      to_string(sfs_hash.as_unsigned) + "_" + to_string(scale) + ".tga";
+  bool readNormalMapFile(core::NormalMapBaker &baker, const string &path_base,
+                      bool redirect, float scale, std::vector<char> &content)
+  {
+    string bumph_path = path_base + ".BumpH";
 
-    bool was_read = util::readFile(cache_path, content, true);
+    cout<<"readNormalMapFile: "<<bumph_path<<endl;
 
-    if (!was_read)
-    {
-      cacheNormalMap(bumph_path, cache_path, scale);
-      was_read = util::readFile(cache_path, content, true);
-    }
+    bool was_read = baker.get(bumph_path, scale, content);
 
     if (was_read && redirect)
-      sfs::redirect(sfs::getHash(bumph_path.c_str()), sfs::getHash("NULL"));
+      sfs::redirect(sfs::getHash(bumph_path.c_str()), getNullHash());
 
     return was_read;
   }
@@ -137,9 +115,11 @@ namespace
 }
 
 
-core::RessourceLoader::RessourceLoader(const string &map_dir, const string &ini_path, const std::string &dump_path) :
+core::RessourceLoader::RessourceLoader(const string &map_dir, const string &ini_path, const std::string &dump_path,
+                                       bool low_memory) :
   map_dir(map_dir),
-  dump_dir(dump_path + '/')
+  dump_dir(dump_path + '/'),
+  normal_map_baker(low_memory)
 {
   LOG_TRACE<<"reading load.ini"<<endl;
   std::vector<char> ini_content;
@@ -150,6 +130,8 @@ core::RessourceLoader::RessourceLoader(const string &map_dir, const string &ini_
 
   dumpFile("load.ini", ini_content.data(), ini_content.size(), dump_dir);
 
+  ini_file_key = ::getFileKey(sfs::getHash(ini_path.c_str()), ini_content.size());
+
   LOG_TRACE<<"parsing load.ini"<<endl;
   reader = make_unique<INIReader>(ini_content.data(), ini_content.size());
   if (reader->ParseError()) {
@@ -185,46 +167,79 @@ glm::vec3 core::RessourceLoader::getWaterColor(const glm::vec3 &default_value)
 }
 
 
-bool core::RessourceLoader::readFile(const char *section,
+string core::RessourceLoader::getFilePath(const char *section,
           const char *name,
           const char *default_path,
-          const char *suffix,
-          std::vector<char> &content)
+          const char *suffix)
 {
+  string key = makeEntryKey(section, name, default_path);
+  key += '\0';
+  if (suffix)
+    key += suffix;
+
+  auto it = file_paths.find(key);
+  if (it != file_paths.end())
+    return it->second;
+
   string path = reader->Get(section, name, default_path);
-  if (path.empty())
-    return false;
+  if (!path.empty())
+  {
+    path = map_dir + path;
+    if (suffix)
+      path += suffix;
+  }
 
-  path = map_dir + path;
+  file_paths[key] = path;
 
-  if (suffix)
-    path += suffix;
+  return path;
+}
 
-  return sfs::readFile(path, content);
+
+string core::RessourceLoader::makeEntryKey(const char *section,
+          const char *name,
+          const char *default_path)
+{
+  string key = section;
+  key += '\0';
+  key += name;
+  key += '\0';
+  key += default_path;
+  return key;
 }
 
 
-bool core::RessourceLoader::readTextureFile(const char *section,
+core::RessourceLoader::TextureEntry &
+core::RessourceLoader::getTextureEntry(const char *section,
           const char *name,
           const char *default_path,
-          std::vector<char> &content,
-          bool from_map_dir,
-          bool redirect,
-          float *scale,
-          bool is_bumpmap)
+          bool from_map_dir)
 {
+  auto key = makeEntryKey(section, name, default_path);
+  key += from_map_dir ? '1' : '0';
+
+  auto it = texture_entries.find(key);
+  if (it != texture_entries.end())
+    return it->second;
+
+  auto &entry = texture_entries[key];
+
+  // "file name[,scale]"
   string value = reader->Get(section, name, default_path);
   if (value.empty())
-    return false;
+    return entry;
+
+  entry.exists = true;
 
   size_t comma_pos = value.find_first_of(',');
-  if (scale && comma_pos != string::npos && value.size() > comma_pos+1)
+  if (comma_pos != string::npos && value.size() > comma_pos+1)
   {
     string scale_str = value.substr(comma_pos+1, string::npos);
 
+    entry.has_scale = true;
+
     try
     {
-      *scale = stof(scale_str);
+      entry.scale = stof(scale_str);
     }
     catch (...)
     {
@@ -232,33 +247,121 @@ bool core::RessourceLoader::readTextureFile(const char *section,
       LOG_ERROR<<"section: "<<section<<endl;
       LOG_ERROR<<"key: "<<name<<endl;
       LOG_ERROR<<"value: "<<value<<endl;
-      *scale = 1;
+      entry.scale = 1;
     }
   }
 
   string filename = value.substr(0, comma_pos);
 
-  string filename_base = filename.substr(0, filename.find_last_of('.'));
-
-  bool was_read = false;
-
   string dir = (from_map_dir) ? map_dir : "maps/_Tex/";
 
-  if (is_bumpmap)
+  entry.path_base = dir + filename.substr(0, filename.find_last_of('.'));
+
+  // .tgb takes precedence
+  for (auto ext : { ".tgb", ".tga" })
   {
-    was_read = ::readNormalMapFile(dir, filename_base, redirect, *scale, content);
+    entry.path = entry.path_base + ext;
+    entry.hash = sfs::getHash(entry.path.c_str());
+    if (sfs::getFileSize(entry.path, entry.size))
+      break;
+    entry.size = -1;
   }
-  else
+
+  return entry;
+}
+
+
+bool core::RessourceLoader::readFile(const char *section,
+          const char *name,
+          const char *default_path,
+          const char *suffix,
+          std::vector<char> &content)
+{
+  string path = getFilePath(section, name, default_path, suffix);
+  if (path.empty())
+    return false;
+
+  return sfs::readFile(path, content);
+}
+
+
+bool core::RessourceLoader::readTextureFile(const char *section,
+          const char *name,
+          const char *default_path,
+          std::vector<char> &content,
+          bool from_map_dir,
+          bool redirect,
+          float *scale,
+          bool is_bumpmap)
+{
+  auto &entry = getTextureEntry(section, name, default_path, from_map_dir);
+  if (!entry.exists)
+    return false;
+
+  if (scale && entry.has_scale)
+    *scale = entry.scale;
+
+  if (is_bumpmap)
+    return ::readNormalMapFile(normal_map_baker, entry.path_base, redirect, *scale, content);
+
+  if (entry.size < 0)
+    return false;
+
+  bool was_read = sfs::readFile(entry.path, content);
+
+  if (was_read && redirect && !entry.is_redirected)
   {
-    was_read = ::readTextureFile(dir, filename_base, ".tgb", redirect, content);
-    if (!was_read)
-      was_read = ::readTextureFile(dir, filename_base, ".tga", redirect, content);
+    sfs::redirect(entry.hash, getDummyTextureHash());
+    entry.is_redirected = true;
   }
 
   return was_read;
 }
 
 
+string core::RessourceLoader::getFileKey(const char *section,
+          const char *name,
+          const char *default_path,
+          const char *suffix)
+{
+  string path = getFilePath(section, name, default_path, suffix);
+  if (path.empty())
+    return "none";
+
+  return ::getFileKey(path);
+}
+
+
+string core::RessourceLoader::getTextureFileKey(const char *section,
+          const char *name,
+          const char *default_path,
+          bool from_map_dir,
+          float *scale)
+{
+  auto &entry = getTextureEntry(section, name, default_path, from_map_dir);
+  if (!entry.exists)
+    return "none";
+
+  if (scale && entry.has_scale)
+    *scale = entry.scale;
+
+  return ::getFileKey(entry.hash, entry.size);
+}
+
+
+void core::RessourceLoader::prepareNormalMap(const char *section,
+          const char *name,
+          const char *default_path,
+          bool from_map_dir)
+{
+  auto &entry = getTextureEntry(section, name, default_path, from_map_dir);
+  if (!entry.exists)
+    return;
+
+  normal_map_baker.submit(entry.path_base + ".BumpH", entry.has_scale ? entry.scale : 1);
+}
+
+
 bool core::RessourceLoader::readWaterAnimation(const string &file_name, std::vector<char> &content)
 {
   string path = getWaterAnimationDir() + file_name;
@@ -19,10 +19,13 @@
 #ifndef CORE_RESSOURCE_LOADER_H
 #define CORE_RESSOURCE_LOADER_H
 
+#include "normal_map_baker.h"
 #include <il2ge/ressource_loader.h>
 #include <INIReader.h>
 
 #include <memory>
+#include <unordered_map>
+#include <cstdint>
 
 namespace core
 {
@@ -35,7 +38,9 @@ namespace core
     std::string dump_dir;
 
   public:
-    RessourceLoader(const std::string &map_dir, const std::string &ini_path, const std::string &dump_path);
+    // low_memory: see NormalMapBaker
+    RessourceLoader(const std::string &map_dir, const std::string &ini_path, const std::string &dump_path,
+                    bool low_memory = false);
 
     std::string getDumpDir() override;
 
@@ -56,8 +61,64 @@ namespace core
               float *scale,
               bool is_bumpmap) override;
 
+    void prepareNormalMap(const char *section,
+              const char *name,
+              const char *default_path,
+              bool from_map_dir) override;
+
     bool readWaterAnimation(const std::string &file_name, std::vector<char> &content) override;
 
+    // SFS hash and size of the file readFile() / readTextureFile() would read -
+    // meant to be used as part of a cache key
+    std::string getFileKey(const char *section,
+              const char *name,
+              const char *default_path,
+              const char *suffix);
+
+    std::string getTextureFileKey(const char *section,
+              const char *name,
+              const char *default_path,
+              bool from_map_dir,
+              float *scale = nullptr) override;
+
+    std::string getIniFileKey() { return ini_file_key; }
+
+  private:
+    // a load.ini texture entry, resolved on first use
+    struct TextureEntry
+    {
+      bool exists = false;
+      // directory and file name without extension
+      std::string path_base;
+      bool has_scale = false;
+      float scale = 1;
+      // the .tgb file or - if there is none - the .tga file
+      std::string path;
+      int64_t hash = 0;
+      // -1 if the file doesn't exist
+      long size = -1;
+      bool is_redirected = false;
+    };
+
+    std::string ini_file_key;
+    NormalMapBaker normal_map_baker;
+    std::unordered_map<std::string, TextureEntry> texture_entries;
+    std::unordered_map<std::string, std::string> file_paths;
+
+    static std::string makeEntryKey(const char *section,
+              const char *name,
+              const char *default_path);
+
+    std::string getFilePath(const char *section,
+              const char *name,
+              const char *default_path,
+              const char *suffix);
+
+    TextureEntry &getTextureEntry(const char *section,
+              const char *name,
+              const char *default_path,
+              bool from_map_dir);
+
   };
 
 
@@ -147,6 +147,8 @@ namespace core
     map.reset();
     gl::Finish();
     sfs::clearRedirections();
+    sfs::logCacheStats();
+    sfs::clearCache();
   }
 
   void Scene::loadMap(const char *path, ProgressReporter *progress)
@@ -40,6 +40,12 @@ public:
 
   Setting<bool> &enable_bumph_maps = addSetting("EnableBumpH", false, "enable terrain bumpmapping");
 
+  Setting<bool> &low_memory_map_loading = addSetting("LowMemoryMapLoading", false,
+                                                     "lower memory usage while loading maps - slower");
+
+  Setting<int> &sfs_cache_size = addSetting("SFSCacheSize", 0,
+                                           "memory in MB for caching game files - 0 disables the cache");
+
   Setting<bool> &enable_cirrus_clouds = addSetting("EnableCirrusClouds", false,
                                                    "cirrus clouds - experimental");
 
@@ -22,18 +22,32 @@
 #include <file.h>
 
 #include <vector>
+#include <memory>
 #include <cstdint>
 #include <string>
 
+// predefined by the windows toolchains
+#if !defined(_WIN32) && !defined(__int64)
+#define __int64 long long
+#endif
+
 namespace sfs
 {
+  // Reads are served from a read-ahead buffer, seeking in SFS is deferred until
+  // data outside of it is needed.
   class File : public util::File
   {
     int m_fd = -1;
     long m_pos = 0;
     long m_size = 0;
+    // position of the SFS file pointer, -1 if unknown
+    long m_fd_pos = -1;
+    std::vector<char> m_buffer;
+    long m_buffer_offset = 0;
     std::string m_path;
 
+    int readDirect(long offset, char *out, int bytes);
+
   public:
     File(std::string path);
     ~File() override;
@@ -44,10 +58,54 @@ namespace sfs
     bool eof() override;
     void readAll(std::vector<char>&) override;
     int getSize() override;
+
+    // doesn't change the current position - returns the number of bytes read
+    int readAt(long offset, char *out, int bytes);
+  };
+
+  struct CacheStats
+  {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t num_entries = 0;
+    size_t size = 0;
+    size_t budget = 0;
+  };
+
+  // All file access goes through the backend - by default the game's SFS functions.
+  class Backend
+  {
+  public:
+    virtual ~Backend() {}
+
+    // returns -1 if there is no such file
+    virtual int open(__int64 hash) = 0;
+    virtual void close(int fd) = 0;
+    // returns the number of bytes read or -1
+    virtual int read(int fd, void *buffer, unsigned int bytes) = 0;
+    // origin is SEEK_SET/SEEK_CUR/SEEK_END - returns the new position or -1
+    virtual long seek(int fd, long offset, int origin) = 0;
   };
 
+  // Plain file system access to the files below root_dir (which corresponds to
+  // the game directory) - for use outside the game, e.g. for tests and benchmarks.
+  std::unique_ptr<Backend> createDirectoryBackend(const std::string &root_dir);
+
+  // Replaces the game backend - init() is a no-op afterwards.
+  void setBackend(std::unique_ptr<Backend>);
+
+  // Sets up the game backend, unless setBackend() was called before.
   void init();
   bool readFile(const std::string &filename, std::vector<char> &out);
+
+  // Optional LRU cache for readFile() - a budget of 0 disables it.
+  void setCacheBudget(size_t bytes);
+  void clearCache();
+  CacheStats getCacheStats();
+  void logCacheStats();
+
+  bool getFileSize(const std::string &filename, long &size);
   __int64 getHash(const char *filename);
   void redirect(__int64 hash, __int64 hash_redirection);
   void clearRedirections();
@@ -91,7 +91,7 @@ string getMaterialPath(const string &parameter_file_path,
   else
   {
     auto &class_info = params.getSection("ClassInfo");
-    auto &based_on = class_info.at("BasedOn");
+    string based_on(class_info.at("BasedOn"));
     auto path = resolveRelativePath(util::getDirFromPath(parameter_file_path), based_on);
     return getMaterialPath(path, parameter_files);
   }
@@ -128,7 +128,7 @@ const Effect3DParameters &getParams(const string &file_name)
 
     auto &file = g_parameter_files.get(file_name);
     auto &class_info = file.getSection("ClassInfo");
-    auto class_name = class_info.at("ClassName");
+    string class_name(class_info.at("ClassName"));
 
     params = il2ge::createEffect3DParameters(class_name);
     assert(params);
@@ -0,0 +1,187 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Serves SFS requests from an unpacked directory tree.
+ * The index maps the SFS hash of each file's path relative to the root
+ * (see sfs::getHash()) to the file's location on disk.
+ */
+
+#include "sfs.h"
+#include <log.h>
+#include <il2ge/thread_pool.h>
+
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cassert>
+#include <stdexcept>
+
+using std::endl;
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+
+class DirectoryBackend : public sfs::Backend
+{
+  il2ge::Mutex m_mutex;
+  std::unordered_map<__int64, std::string> m_index;
+  // indexed by fd - closed slots are nullptr
+  std::vector<FILE*> m_files;
+
+  FILE *getFile(int fd)
+  {
+    if (fd < 0 || fd >= int(m_files.size()))
+      return nullptr;
+    return m_files[fd];
+  }
+
+public:
+  DirectoryBackend(const std::string &root_dir)
+  {
+    std::error_code error;
+    fs::recursive_directory_iterator it(root_dir, error);
+    if (error)
+      throw std::runtime_error("Failed to open directory " + root_dir + ": " + error.message());
+
+    for (; it != fs::recursive_directory_iterator(); it.increment(error))
+    {
+      if (error)
+        throw std::runtime_error("Failed to read directory " + root_dir + ": " + error.message());
+
+      if (!it->is_regular_file())
+        continue;
+
+      auto relative_path = it->path().lexically_relative(root_dir).generic_string();
+      auto hash = sfs::getHash(relative_path.c_str());
+
+      auto res = m_index.insert({ hash, it->path().string() });
+      if (!res.second)
+      {
+        LOG_WARNING << "SFS: " << relative_path << " has the same hash as "
+                    << res.first->second << " - ignoring it" << endl;
+      }
+    }
+
+    LOG_INFO << "SFS: indexed " << m_index.size() << " files in " << root_dir << endl;
+  }
+
+  ~DirectoryBackend() override
+  {
+    for (auto file : m_files)
+    {
+      if (file)
+        fclose(file);
+    }
+  }
+
+  int open(__int64 hash) override
+  {
+    il2ge::MutexLock lock(m_mutex);
+
+    auto it = m_index.find(hash);
+    if (it == m_index.end())
+      return -1;
+
+    auto file = fopen(it->second.c_str(), "rb");
+    if (!file)
+    {
+      LOG_ERROR << "SFS: failed to open " << it->second << endl;
+      return -1;
+    }
+
+    for (size_t i = 0; i < m_files.size(); i++)
+    {
+      if (!m_files[i])
+      {
+        m_files[i] = file;
+        return i;
+      }
+    }
+
+    m_files.push_back(file);
+    return m_files.size() - 1;
+  }
+
+  void close(int fd) override
+  {
+    il2ge::MutexLock lock(m_mutex);
+
+    auto file = getFile(fd);
+    assert(file);
+    if (file)
+    {
+      fclose(file);
+      m_files[fd] = nullptr;
+    }
+  }
+
+  int read(int fd, void *buffer, unsigned int bytes) override
+  {
+    FILE *file = nullptr;
+    {
+      il2ge::MutexLock lock(m_mutex);
+      file = getFile(fd);
+    }
+
+    if (!file)
+      return -1;
+
+    auto ret = fread(buffer, 1, bytes, file);
+    if (ret < bytes && ferror(file))
+      return -1;
+
+    return ret;
+  }
+
+  long seek(int fd, long offset, int origin) override
+  {
+    FILE *file = nullptr;
+    {
+      il2ge::MutexLock lock(m_mutex);
+      file = getFile(fd);
+    }
+
+    if (!file || fseek(file, offset, origin) != 0)
+      return -1;
+
+    return ftell(file);
+  }
+};
+
+
+} // namespace
+
+
+namespace sfs
+{
+
+
+std::unique_ptr<Backend> createDirectoryBackend(const std::string &root_dir)
+{
+  return std::make_unique<DirectoryBackend>(root_dir);
+}
+
+
+}
@@ -0,0 +1,129 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2018 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The default SFS backend - forwards to the SFS functions exported by the game.
+ */
+
+#include "sfs.h"
+#include "sfs_p.h"
+
+#include <memory>
+#include <cassert>
+#include <windef.h>
+#include <winbase.h>
+
+// #define SFS_API __cdecl
+#define SFS_API __stdcall
+
+
+namespace
+{
+
+typedef int __cdecl SAS_SFS_openf_T(unsigned __int64 hash, int flags);
+typedef int SFS_API SFS_close_T(int fd);
+typedef int SFS_API SFS_read_T(int fd, void *buffer, unsigned int numberOfBytesToRead);
+typedef long SFS_API SFS_lseek_T(int fd, long offset, int moveMethod);
+
+SAS_SFS_openf_T wrap_SFS_openf;
+
+SAS_SFS_openf_T *g_openf_func = nullptr;
+SFS_close_T *g_close_func = nullptr;
+SFS_read_T *g_read_func = nullptr;
+SFS_lseek_T *g_lseek_func = nullptr;
+
+
+class GameBackend : public sfs::Backend
+{
+public:
+  int open(__int64 hash) override
+  {
+    return g_openf_func(hash, 0);
+  }
+
+  void close(int fd) override
+  {
+    g_close_func(fd);
+  }
+
+  int read(int fd, void *buffer, unsigned int bytes) override
+  {
+    return g_read_func(fd, buffer, bytes);
+  }
+
+  long seek(int fd, long offset, int origin) override
+  {
+    return g_lseek_func(fd, offset, origin);
+  }
+};
+
+
+int __cdecl wrap_SFS_openf(unsigned __int64 hash, int flags)
+{
+  assert(g_openf_func);
+
+//   auto it = g_redirections.find(hash);
+//   if (it != g_redirections.end())
+//     hash = it->second;
+
+  return g_openf_func(hash, flags);
+}
+
+
+} // namespace
+
+
+namespace sfs
+{
+
+
+void init()
+{
+  if (!sfs_private::hasBackend())
+  {
+    HMODULE m = GetModuleHandle(0);
+    assert(m);
+
+    g_close_func = (SFS_close_T*) GetProcAddress(m, "SFS_close");
+    assert(g_close_func);
+
+    g_read_func = (SFS_read_T*) GetProcAddress(m, "SFS_read");
+    assert(g_read_func);
+
+    g_lseek_func = (SFS_lseek_T*) GetProcAddress(m, "SFS_lseek");
+    assert(g_lseek_func);
+
+    m = GetModuleHandle("wrapper.dll");
+    assert(m);
+
+    g_openf_func = (SAS_SFS_openf_T*) GetProcAddress(m, "__SFS_openf");
+    assert(g_openf_func);
+
+    setBackend(std::make_unique<GameBackend>());
+  }
+}
+
+
+void *get_openf_wrapper()
+{
+  init();
+  return (void*) &wrap_SFS_openf;
+}
+
+
+} // namespace sfs
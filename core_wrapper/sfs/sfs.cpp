@@ -19,90 +19,157 @@
 #include "sfs.h"
 #include "sfs_p.h"
 #include <util.h>
+#include <log.h>
+#include <il2ge/thread_pool.h>
 
 #include <iostream>
 #include <string>
 #include <unordered_map>
+#include <list>
 #include <cassert>
 #include <cstdlib>
 #include <cstdio>
-#include <windef.h>
-#include <winbase.h>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
 
 using std::cout;
 using std::endl;
 using std::unordered_map;
 
-// #define SFS_API __cdecl
-#define SFS_API __stdcall
-
 
 namespace
 {
 
-typedef int __cdecl SAS_SFS_openf_T(unsigned __int64 hash, int flags);
-typedef int SFS_API SFS_close_T(int fd);
-typedef int SFS_API SFS_read_T(int fd, void *buffer, unsigned int numberOfBytesToRead);
-typedef long SFS_API SFS_lseek_T(int fd, long offset, int moveMethod);
-
-SAS_SFS_openf_T wrap_SFS_openf;
+constexpr int READ_AHEAD_SIZE = 64 * 1024;
 
-bool g_initialized = false;
-SAS_SFS_openf_T *g_openf_func = nullptr;
-SFS_close_T *g_close_func = nullptr;
-SFS_read_T *g_read_func = nullptr;
-SFS_lseek_T *g_lseek_func = nullptr;
 unordered_map<__int64, __int64> g_redirections;
 
 
-int open(const char *filename)
+std::unique_ptr<sfs::Backend> g_backend;
+
+
+sfs::Backend &getBackend()
 {
-  return g_openf_func(sfs::getHash(filename), 0);
+  assert(g_backend);
+  return *g_backend;
 }
 
 
-int __cdecl wrap_SFS_openf(unsigned __int64 hash, int flags)
+// Keyed by the SFS hash of the path, the most recently used entry is at the front.
+class ContentCache
 {
-  assert(g_openf_func);
+  struct Entry
+  {
+    __int64 hash = 0;
+    std::vector<char> content;
+  };
 
-//   auto it = g_redirections.find(hash);
-//   if (it != g_redirections.end())
-//     hash = it->second;
+  il2ge::Mutex m_mutex;
+  std::list<Entry> m_entries;
+  unordered_map<__int64, std::list<Entry>::iterator> m_index;
+  sfs::CacheStats m_stats;
 
-  return g_openf_func(hash, flags);
-}
+  void evict(size_t budget)
+  {
+    while (m_stats.size > budget && !m_entries.empty())
+    {
+      auto &entry = m_entries.back();
+      m_stats.size -= entry.content.size();
+      m_stats.evictions++;
+      m_index.erase(entry.hash);
+      m_entries.pop_back();
+    }
+    m_stats.num_entries = m_entries.size();
+  }
 
+public:
+  bool get(__int64 hash, std::vector<char> &out)
+  {
+    il2ge::MutexLock lock(m_mutex);
 
-} // namespace
+    if (!m_stats.budget)
+      return false;
 
+    auto it = m_index.find(hash);
+    if (it == m_index.end())
+    {
+      m_stats.misses++;
+      return false;
+    }
 
-namespace sfs
-{
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    out = it->second->content;
+    m_stats.hits++;
 
-void init()
-{
-  if (!g_initialized)
+    return true;
+  }
+
+  void add(__int64 hash, const std::vector<char> &content)
   {
-    HMODULE m = GetModuleHandle(0);
-    assert(m);
+    il2ge::MutexLock lock(m_mutex);
 
-    g_close_func = (SFS_close_T*) GetProcAddress(m, "SFS_close");
-    assert(g_close_func);
+    // a single big file shouldn't flush everything else
+    if (content.size() > m_stats.budget / 4 || m_index.count(hash))
+      return;
 
-    g_read_func = (SFS_read_T*) GetProcAddress(m, "SFS_read");
-    assert(g_read_func);
+    m_entries.push_front({ hash, content });
+    m_index[hash] = m_entries.begin();
+    m_stats.size += content.size();
 
-    g_lseek_func = (SFS_lseek_T*) GetProcAddress(m, "SFS_lseek");
-    assert(g_lseek_func);
+    evict(m_stats.budget);
+  }
 
-    m = GetModuleHandle("wrapper.dll");
-    assert(m);
+  void setBudget(size_t bytes)
+  {
+    il2ge::MutexLock lock(m_mutex);
+    m_stats.budget = bytes;
+    evict(bytes);
+  }
 
-    g_openf_func = (SAS_SFS_openf_T*) GetProcAddress(m, "__SFS_openf");
-    assert(g_openf_func);
+  void clear()
+  {
+    il2ge::MutexLock lock(m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    m_stats.size = 0;
+    m_stats.num_entries = 0;
+  }
 
-    g_initialized = true;
+  sfs::CacheStats getStats()
+  {
+    il2ge::MutexLock lock(m_mutex);
+    return m_stats;
   }
+};
+
+
+ContentCache g_cache;
+
+
+int open(const char *filename)
+{
+  return getBackend().open(sfs::getHash(filename));
+}
+
+
+} // namespace
+
+
+bool sfs_private::hasBackend()
+{
+  return g_backend != nullptr;
+}
+
+
+namespace sfs
+{
+
+void setBackend(std::unique_ptr<Backend> backend)
+{
+  assert(backend);
+  g_backend = std::move(backend);
+  g_cache.clear();
 }
 
 
@@ -126,44 +193,95 @@ __int64 getHash(const char *filename)
 bool readFile(const std::string &filename, std::vector<char> &out)
 {
   auto path = util::resolveRelativePathComponents(filename);
+  auto hash = getHash(path.c_str());
 
-  auto fd = open(path.c_str());
+  if (g_cache.get(hash, out))
+    return true;
+
+  auto &backend = getBackend();
+
+  auto fd = backend.open(hash);
 
   if (fd == -1)
     return false;
 
-  auto size = g_lseek_func(fd, 0, SEEK_END);
-  g_lseek_func(fd, 0, SEEK_SET);
+  auto size = backend.seek(fd, 0, SEEK_END);
+  backend.seek(fd, 0, SEEK_SET);
 
   out.resize(size);
 
-  auto ret = g_read_func(fd, out.data(), size);
+  auto ret = backend.read(fd, out.data(), size);
+
+  backend.close(fd);
 
-  g_close_func(fd);
+  bool success = ret > 0 ? ((unsigned int)ret) == size : false;
 
-  return ret > 0 ? ((unsigned int)ret) == size : false;
+  if (success)
+    g_cache.add(hash, out);
+
+  return success;
 }
 
 
-void redirect(__int64 hash, __int64 hash_redirection)
+void setCacheBudget(size_t bytes)
 {
-  g_redirections[hash] = hash_redirection;
+  g_cache.setBudget(bytes);
 }
 
-void clearRedirections()
+
+void clearCache()
 {
-  cout<<"SFS wrapper: clearing "<<g_redirections.size()<<" redirections."<<endl;
-  g_redirections.clear();
+  g_cache.clear();
 }
 
 
-void *get_openf_wrapper()
+CacheStats getCacheStats()
 {
-  sfs::init();
-  return (void*) &wrap_SFS_openf;
+  return g_cache.getStats();
 }
 
 
+void logCacheStats()
+{
+  auto stats = getCacheStats();
+
+  if (!stats.budget)
+    return;
+
+  LOG_INFO << "SFS cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+           << stats.evictions << " evictions, " << stats.num_entries << " files, "
+           << stats.size / 1024 << " / " << stats.budget / 1024 << " KB" << endl;
+}
+
+
+bool getFileSize(const std::string &filename, long &size)
+{
+  auto path = util::resolveRelativePathComponents(filename);
+
+  auto fd = open(path.c_str());
+
+  if (fd == -1)
+    return false;
+
+  size = getBackend().seek(fd, 0, SEEK_END);
+
+  getBackend().close(fd);
+
+  return size >= 0;
+}
+
+
+void redirect(__int64 hash, __int64 hash_redirection)
+{
+  g_redirections[hash] = hash_redirection;
+}
+
+void clearRedirections()
+{
+  cout<<"SFS wrapper: clearing "<<g_redirections.size()<<" redirections."<<endl;
+  g_redirections.clear();
+}
+
 
 File::File(std::string path) : m_path(path)
 {
@@ -171,27 +289,99 @@ File::File(std::string path) : m_path(path)
   if (m_fd == -1)
     throw std::runtime_error("Failed to open " + path);
 
-  m_size = g_lseek_func(m_fd, 0, SEEK_END);
-  g_lseek_func(m_fd, 0, SEEK_SET);
+  m_size = getBackend().seek(m_fd, 0, SEEK_END);
+  m_fd_pos = m_size;
 }
 
 
 File::~File()
 {
-  g_close_func(m_fd);
+  getBackend().close(m_fd);
 }
 
 
-int File::read(char *out, int bytes)
+int File::readDirect(long offset, char *out, int bytes)
 {
-  assert(m_pos < m_size);
+  assert(offset >= 0);
 
-  auto ret = g_lseek_func(m_fd, m_pos, SEEK_SET);
-  assert(ret == m_pos);
+  if (m_fd_pos != offset)
+  {
+    auto ret = getBackend().seek(m_fd, offset, SEEK_SET);
+    assert(ret == offset);
+    if (ret != offset)
+    {
+      m_fd_pos = -1;
+      return 0;
+    }
+    m_fd_pos = offset;
+  }
 
-  ret = g_read_func(m_fd, out, bytes);
-  assert(ret != -1);
+  auto ret = getBackend().read(m_fd, out, bytes);
   assert(ret >= 0);
+  if (ret < 0)
+  {
+    m_fd_pos = -1;
+    return 0;
+  }
+
+  m_fd_pos += ret;
+
+  return ret;
+}
+
+
+int File::readAt(long offset, char *out, int bytes)
+{
+  assert(offset >= 0);
+  assert(bytes >= 0);
+
+  if (offset >= m_size)
+    return 0;
+
+  bytes = std::min<long>(bytes, m_size - offset);
+
+  int total = 0;
+
+  while (total < bytes)
+  {
+    long buffer_end = m_buffer_offset + long(m_buffer.size());
+
+    if (offset >= m_buffer_offset && offset < buffer_end)
+    {
+      int n = std::min<long>(bytes - total, buffer_end - offset);
+      memcpy(out + total, m_buffer.data() + (offset - m_buffer_offset), n);
+      total += n;
+      offset += n;
+      continue;
+    }
+
+    int remaining = bytes - total;
+
+    // large reads bypass the buffer
+    if (remaining >= READ_AHEAD_SIZE)
+    {
+      auto ret = readDirect(offset, out + total, remaining);
+      total += ret;
+      break;
+    }
+
+    m_buffer.resize(std::min<long>(READ_AHEAD_SIZE, m_size - offset));
+    m_buffer_offset = offset;
+
+    auto ret = readDirect(offset, m_buffer.data(), m_buffer.size());
+    m_buffer.resize(ret);
+
+    if (ret == 0)
+      break;
+  }
+
+  return total;
+}
+
+
+int File::read(char *out, int bytes)
+{
+  auto ret = readAt(m_pos, out, bytes);
 
   m_pos += ret;
   assert(m_pos <= m_size);
@@ -204,16 +394,12 @@ void File::skip(int bytes)
 {
   m_pos += bytes;
   assert(m_pos >= 0);
-
-  auto ret = g_lseek_func(m_fd, m_pos, SEEK_SET);
-  assert(ret == m_pos);
 }
 
 
 void File::rewind()
 {
   m_pos = 0;
-  g_lseek_func(m_fd, m_pos, SEEK_SET);
 }
 
 
@@ -223,19 +409,19 @@ bool File::eof()
 }
 
 
+// a single bulk read - the current position isn't changed
 void File::readAll(std::vector<char> &out)
 {
-  assert(m_pos == 0);
-  assert(!eof());
-
-  bool success = false;
-
   out.resize(m_size);
 
-  auto ret = read(out.data(), out.size());
-  assert(ret == m_size);
+  int read = 0;
+
+  // the buffer is bypassed since the whole file is read anyway
+  if (m_size)
+    read = readDirect(0, out.data(), out.size());
 
-  rewind();
+  assert(read == m_size);
+  out.resize(read);
 }
 
 
@@ -37,9 +37,103 @@ template <>
 std::shared_ptr<render_util::ImageRGBA>
 loadImageFromMemory<render_util::ImageRGBA>(const std::vector<char> &data, const char *name);
 
+enum class ImageFormat
+{
+  UNKNOWN,
+  IMF,
+  TGA,
+  RAW // see encodeRawImage()
+};
+
+
+struct ImageInfo
+{
+  ImageFormat format = ImageFormat::UNKNOWN;
+  glm::ivec2 size {};
+  // channels of the image returned by loadImageFromMemory() - IMF is always decoded to RGBA
+  int num_channels = 0;
+};
+
+
+// Reads only the header - returns false if the format is unknown or the header is invalid.
+// format is set if it was recognized, even if the header is invalid.
+bool probeImage(const char *data, size_t size, ImageInfo &info);
+bool probeImage(const std::vector<char> &data, ImageInfo &info);
+bool probeImage(util::File &file, ImageInfo &info);
+
+struct DecodeOptions
+{
+  // 0: keep the channels reported by probeImage()
+  int num_channels = 0;
+  bool flip_y = false;
+};
+
+// Decodes into caller provided storage, which must hold
+// info.size.x * info.size.y * num_channels bytes (info as returned by probeImage()).
+// Formats unknown to probeImage() are passed to render_util.
+// Flipping and channel conversion are applied while decoding.
+bool decodeImage(const std::vector<char> &data, unsigned char *dst, size_t dst_size,
+                 const DecodeOptions &options, const char *name);
+
+// Copies an already decoded image into caller provided storage, like decodeImage().
+bool copyImage(const render_util::GenericImage &image, unsigned char *dst, size_t dst_size,
+               const DecodeOptions &options, const char *name);
+
+// Allocates a single image of type T and decodes into it - returns nullptr on failure.
+template <class T>
+std::shared_ptr<T> decodeImage(const std::vector<char> &data, const char *name,
+                               bool flip_y = false)
+{
+  DecodeOptions options;
+  options.flip_y = flip_y;
+
+  ImageInfo info;
+  if (!probeImage(data, info))
+  {
+    // the size is only known after decoding - costs one temporary image
+    auto decoded = render_util::loadImageFromMemory<render_util::GenericImage>(data);
+    if (!decoded)
+      return {};
+
+    auto image = std::make_shared<T>(decoded->getSize());
+    options.num_channels = image->getDataSize() / (size_t(image->w()) * image->h());
+
+    if (!copyImage(*decoded, image->getData(), image->getDataSize(), options, name))
+      return {};
+
+    return image;
+  }
+
+  auto image = std::make_shared<T>(info.size);
+
+  options.num_channels = image->getDataSize() / (size_t(info.size.x) * info.size.y);
+
+  if (!decodeImage(data, image->getData(), image->getDataSize(), options, name))
+  {
+    return {};
+  }
+
+  return image;
+}
+
+// Uncompressed format for generated images (e.g. baked normal maps) -
+// supported by probeImage() and decodeImage(). Rows are stored top to bottom.
+// Returns an empty vector if the size is not supported.
+std::vector<char> encodeRawImage(const unsigned char *data, glm::ivec2 size, int num_channels);
+
+template <class T>
+std::vector<char> encodeRawImage(const T &image)
+{
+  return encodeRawImage(image.getData(), image.getSize(),
+                        image.getDataSize() / (size_t(image.w()) * image.h()));
+}
+
 bool isIMF(util::File &file);
-void getIMFInfo(util::File&, int &w, int &h);
+// returns false if the header is invalid
+bool getIMFInfo(util::File&, int &w, int &h);
+// return nullptr on failure
 std::unique_ptr<render_util::GenericImage> loadIMF(const std::vector<char> &data, int force_channels);
+std::unique_ptr<render_util::GenericImage> loadIMF(util::File &file, int force_channels);
 
 std::shared_ptr<render_util::GenericImage> loadImageFromMemory(const std::vector<char> &data,
                                                                const char *name);
@@ -25,7 +25,10 @@
 #include <render_util/land_textures.h>
 
 #include <glm/glm.hpp>
+#include <functional>
 #include <map>
+#include <string>
+#include <vector>
 
 
 namespace render_util
@@ -38,6 +41,7 @@ namespace render_util
 namespace il2ge
 {
   class RessourceLoader;
+  class MemoryStats;
 
   enum
   {
@@ -50,13 +54,96 @@ namespace il2ge
 
 namespace il2ge::map_loader
 {
+  // Everything derived from the map's input files that doesn't depend on a GL context.
+  // It can be stored in the baked map cache, so a warm load skips decoding and processing.
+  struct BakedMap
+  {
+    render_util::ImageGreyScale::ConstPtr pixel_map_h;
+    render_util::ElevationMap::ConstPtr elevation_map;
+    render_util::ImageGreyScale::ConstPtr type_map;
+    render_util::ImageGreyScale::ConstPtr land_type_map;
+    render_util::ImageGreyScale::ConstPtr water_type_map;
+    render_util::ImageGreyScale::ConstPtr forest_map;
+    render_util::TerrainBase::MaterialMap::ConstPtr material_map;
+    std::vector<render_util::ImageGreyScale::ConstPtr> water_map_chunks;
+    render_util::Image<unsigned int>::ConstPtr water_map_table;
+    render_util::ImageRGBA::ConstPtr far_texture;
+  };
+
+  // Images needed by createMapTextures() that aren't part of BakedMap.
+  struct MapTextureImages
+  {
+    std::vector<render_util::ImageRGBA::ConstPtr> water_normal_maps;
+    std::vector<render_util::ImageGreyScale::ConstPtr> water_foam_masks;
+    render_util::ImageGreyScale::Ptr noise_texture;
+    render_util::ImageRGBA::ConstPtr shallow_water;
+    std::vector<render_util::ImageRGBA::ConstPtr> beach;
+    glm::vec3 water_color = glm::vec3(0);
+    render_util::ImageRGBA::ConstPtr forest_far_texture;
+    std::vector<render_util::ImageRGBA::ConstPtr> forest_layers;
+    std::shared_ptr<render_util::GenericImage> cirrus_texture;
+  };
+
+  // Receives the progress (0 - 1) of the current function and a description of the current step.
+  // Gets called from the thread the loading function runs on.
+  using ProgressFunc = std::function<void(float fraction, const std::string &description)>;
+
+  struct InputFile
+  {
+    const char *section = nullptr;
+    const char *name = nullptr;
+    const char *default_path = nullptr;
+    const char *suffix = nullptr;
+    bool is_texture = false;
+    bool from_map_dir = false;
+  };
+
   bool isDumpEnabled();
 
+  // the files BakedMap is derived from
+  std::vector<InputFile> getBakedMapInputFiles();
+
+  // fills all members that are missing, except far_texture
+  // throws std::runtime_error on malformed input files
+  void bakeMap(il2ge::RessourceLoader*, BakedMap&, ProgressFunc = {});
+
+  // key identifies the input files - a cache file with a different key is ignored
+  bool loadBakedMap(const std::string &path, const std::string &key, BakedMap&);
+  bool saveBakedMap(const std::string &path, const std::string &key, const BakedMap&);
+
+  // creates baked_map.far_texture if missing
+  // low_memory: decode fewer field textures at the same time - slower, but lowers the peak footprint
+  void createLandTextures(il2ge::RessourceLoader*,
+                          BakedMap &baked_map,
+                          render_util::LandTextures&,
+                          bool enable_normal_maps,
+                          ProgressFunc = {},
+                          MemoryStats* = nullptr,
+                          bool low_memory = false);
+
   void createLandTextures(il2ge::RessourceLoader*,
                           render_util::ImageGreyScale::ConstPtr type_map,
                           render_util::LandTextures&,
                           bool enable_normal_maps);
 
+  // Calls func(type_name, data_size) for each image.
+  using ImageVisitor = std::function<void(const char *type, size_t size)>;
+  void visitImages(const BakedMap&, const ImageVisitor &func);
+  void visitImages(const MapTextureImages&, const ImageVisitor &func);
+  void visitImages(const render_util::LandTextures&, const ImageVisitor &func);
+
+  // doesn't need a GL context
+  void loadMapTextureImages(il2ge::RessourceLoader*, MapTextureImages&, ProgressFunc = {});
+
+  // needs a GL context
+  void createMapTextures(const BakedMap&,
+                        const MapTextureImages&,
+                        render_util::MapBase*);
+
+  void createMapTextures(il2ge::RessourceLoader*,
+                        const BakedMap&,
+                        render_util::MapBase*);
+
   void createMapTextures(il2ge::RessourceLoader*,
                         render_util::ImageGreyScale::ConstPtr,
                         render_util::MapBase*);
@@ -66,6 +153,9 @@ namespace il2ge::map_loader
 
   render_util::ImageGreyScale::Ptr createPixelMapH(il2ge::RessourceLoader*);
 
+  // Converts map_h values to elevation in meters.
+  void decodeElevation(const unsigned char *indices, float *elevation, size_t count);
+
   render_util::ElevationMap::Ptr createElevationMap(render_util::ImageGreyScale::ConstPtr);
 
   inline render_util::ElevationMap::Ptr createElevationMap(il2ge::RessourceLoader *loader)
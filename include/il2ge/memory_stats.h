@@ -0,0 +1,97 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IL2GE_MEMORY_STATS_H
+#define IL2GE_MEMORY_STATS_H
+
+#include <il2ge/thread_pool.h>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+namespace il2ge
+{
+
+
+struct ProcessMemoryInfo
+{
+  // private bytes on windows, resident set size elsewhere - 0 if unknown
+  size_t current = 0;
+  size_t peak = 0;
+  // used virtual address space - 0 if unknown
+  size_t address_space = 0;
+};
+
+ProcessMemoryInfo getProcessMemoryInfo();
+
+
+// Accounting of the big allocations made while loading, grouped by stage and type.
+// add() and remove() may be called from any thread.
+class MemoryStats
+{
+public:
+  struct Stage
+  {
+    std::string name;
+    std::map<std::string, size_t> allocated_by_type;
+    size_t allocated = 0;
+    size_t peak = 0;
+    ProcessMemoryInfo process_memory;
+  };
+
+  // ends the current stage
+  void beginStage(const std::string &name);
+  void endStage();
+
+  void add(const std::string &type, size_t bytes);
+  void remove(const std::string &type, size_t bytes);
+
+  template <class T>
+  void add(const std::string &type, const std::shared_ptr<T> &image)
+  {
+    if (image)
+      add(type, image->getDataSize());
+  }
+
+  template <class T>
+  void remove(const std::string &type, const std::shared_ptr<T> &image)
+  {
+    if (image)
+      remove(type, image->getDataSize());
+  }
+
+  size_t getCurrent();
+  size_t getPeak();
+
+  void log();
+
+private:
+  Mutex m_mutex;
+  std::vector<Stage> m_stages;
+  bool m_is_stage_active = false;
+  size_t m_current = 0;
+  size_t m_peak = 0;
+};
+
+
+}
+
+#endif
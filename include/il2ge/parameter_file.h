@@ -21,11 +21,14 @@
 
 #include <glm/glm.hpp>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <iostream>
 #include <functional>
 #include <memory>
+#include <optional>
+#include <stdexcept>
 
 namespace il2ge
 {
@@ -34,11 +37,75 @@ namespace il2ge
 class ParameterFile
 {
 public:
+  // Interned parameter name - construct once (e.g. static const) to keep lookups in hot loops cheap.
+  class Key
+  {
+    int m_id = -1;
+
+  public:
+    Key(std::string_view name);
+    Key(const char *name) : Key(std::string_view(name)) {}
+    Key(const std::string &name) : Key(std::string_view(name)) {}
+
+    int getID() const { return m_id; }
+    const std::string &getName() const;
+  };
+
+  // A value, parsed once when the file is loaded.
+  struct Value
+  {
+    enum class Type
+    {
+      STRING,
+      SCALAR,
+      VECTOR
+    };
+
+    Type type = Type::STRING;
+    // the first token as written - points into the file's content
+    std::string_view text;
+    // may be 0
+    size_t num_tokens = 0;
+    // SCALAR and VECTOR - missing components are 0
+    glm::vec4 vec {0};
+    // SCALAR and VECTOR, if the first token is an integer
+    bool has_integer = false;
+    int integer = 0;
+
+    // tokens must be null-terminated - only the first 4 are used
+    Value(const std::string_view *tokens, size_t num_tokens);
+
+    bool isNumeric() const { return type != Type::STRING; }
+
+    bool convert(std::string &value) const;
+    bool convert(int &value) const;
+    bool convert(bool &value) const;
+    bool convert(float &value) const;
+    bool convert(glm::vec4 &value) const;
+    bool convert(glm::vec3 &value) const;
+    bool convert(glm::vec2 &value) const;
+  };
+
   class Section
   {
     friend class ParameterFile;
 
   public:
+    // nullptr if the parameter doesn't exist
+    const Value *find(Key key) const;
+
+    // empty if the parameter doesn't exist or can't be converted to T
+    template <typename T>
+    std::optional<T> get(Key key) const
+    {
+      T value {};
+      auto v = find(key);
+      if (v && v->convert(value))
+        return value;
+      else
+        return {};
+    }
+
     template <typename T>
     void get(const char *name, T &value) const
     {
@@ -53,19 +120,21 @@ public:
       }
     }
 
+    // leaves value untouched if the parameter doesn't exist - only malformed values are logged
     template <typename T>
-    bool get_noexcept(const char *name, T &value) const
+    bool get_noexcept(Key key, T &value) const
     {
-      try
-      {
-        getImp(name, value);
-        return true;
-      }
-      catch(std::exception &e)
+      auto v = find(key);
+      if (!v)
+        return false;
+
+      if (!v->convert(value))
       {
-        std::cout<<"failed to get parameter "<<name<<" : "<<e.what()<<std::endl;
+        std::cout<<"failed to get parameter "<<key.getName()<<" : invalid value"<<std::endl;
         return false;
       }
+
+      return true;
     }
 
 
@@ -76,37 +145,31 @@ public:
       return std::move(s);
     }
 
-    const std::string &at(const char *param) const;
+    std::string_view at(const char *param) const;
 
   private:
-    void getImp(const char *name, std::string &value) const
-    {
-      value = m_values.at(name).at(0);
-    }
-
-    void getImp(const char *name, int &value) const
-    {
-      value = std::stoi(m_values.at(name).at(0));
-    }
-
-    void getImp(const char *name, bool &value) const
-    {
-      value = std::stoi(m_values.at(name).at(0));
-    }
-
-    void getImp(const char *name, float &value) const
+    template <typename T>
+    void getImp(const char *name, T &value) const
     {
-      value = std::stof(m_values.at(name).at(0));
+      auto v = find(name);
+      if (!v)
+        throw std::out_of_range(std::string("no such parameter: ") + name);
+      if (!v->convert(value))
+        throw std::invalid_argument(std::string("invalid value for ") + name);
     }
 
-    void getImp(const char *name, glm::vec4 &value) const;
-    void getImp(const char *name, glm::vec3 &value) const;
-    void getImp(const char *name, glm::vec2 &value) const;
+    void set(Key key, Value &&value);
 
-    std::unordered_map<std::string, std::vector<std::string>> m_values;
+    // few parameters per section - sorted by key ID
+    std::vector<std::pair<int, Value>> m_values;
   };
 
   ParameterFile(const char *content, size_t size);
+  ParameterFile(std::vector<char> &&content);
+
+  // the values point into m_content
+  ParameterFile(const ParameterFile&) = delete;
+  ParameterFile &operator=(const ParameterFile&) = delete;
 
   const Section &getSection(const std::string &name) const;
   const bool hasSection(const std::string &name) const { return m_sections.find(name) != m_sections.end(); }
@@ -114,6 +177,7 @@ public:
   const std::unordered_map<std::string, Section> &getSections() const { return m_sections; }
 
 private:
+  std::vector<char> m_content;
   std::unordered_map<std::string, Section> m_sections;
 };
 
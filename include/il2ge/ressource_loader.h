@@ -49,7 +49,25 @@ namespace il2ge
                             float *scale = nullptr,
                             bool is_bumpmap = false) = 0;
 
+    // Lets the normal map for a later readTextureFile(..., is_bumpmap = true) call
+    // be prepared in the background.
+    virtual void prepareNormalMap(const char *section,
+                            const char *name,
+                            const char *default_path,
+                            bool from_map_dir) {}
+
     virtual bool readWaterAnimation(const std::string &file_name, std::vector<char> &content) = 0;
+
+    // Identifies the file readTextureFile() would read, without reading it.
+    // Equal keys mean equal files - an empty key means unknown.
+    virtual std::string getTextureFileKey(const char *section,
+                            const char *name,
+                            const char *default_path,
+                            bool from_map_dir,
+                            float *scale = nullptr)
+    {
+      return {};
+    }
   };
 }
 
@@ -0,0 +1,111 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IL2GE_THREAD_POOL_H
+#define IL2GE_THREAD_POOL_H
+
+#include <functional>
+#include <memory>
+
+namespace il2ge
+{
+
+
+// Implemented on top of std::thread or - if IL2GE_NO_STD_THREAD is defined
+// (mingw without posix threads) - on top of the win32 api.
+// Jobs must not touch GL or JNI.
+class ThreadPool
+{
+  struct Private;
+  std::unique_ptr<Private> p;
+
+public:
+  using Job = std::function<void()>;
+
+  // num_threads == 0 means one thread per cpu
+  ThreadPool(int num_threads = 0);
+  ~ThreadPool();
+
+  int getNumThreads() const;
+
+  void submit(Job);
+
+  // Blocks until all submitted jobs are finished.
+  // Rethrows the first exception thrown by a job.
+  void wait();
+
+  // Like wait(), but gives up after the timeout.
+  // Returns true if all jobs are finished.
+  bool waitFor(int milliseconds);
+
+  static int getNumCPUs();
+};
+
+
+class Mutex
+{
+  struct Private;
+  std::unique_ptr<Private> p;
+
+  friend class Condition;
+
+public:
+  Mutex();
+  ~Mutex();
+
+  void lock();
+  void unlock();
+};
+
+
+// Waiters must check their predicate in a loop - wakeups may be spurious.
+class Condition
+{
+  struct Private;
+  std::unique_ptr<Private> p;
+
+public:
+  Condition();
+  ~Condition();
+
+  // The mutex must be locked by the caller - it is released while waiting.
+  void wait(Mutex&);
+  void notifyAll();
+};
+
+
+class MutexLock
+{
+  Mutex &m_mutex;
+
+public:
+  MutexLock(Mutex &mutex) : m_mutex(mutex)
+  {
+    m_mutex.lock();
+  }
+
+  ~MutexLock()
+  {
+    m_mutex.unlock();
+  }
+};
+
+
+}
+
+#endif
@@ -0,0 +1,167 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Parses every .eff and .mat file below a directory (e.g. the unpacked SFS files)
+ * and reports the throughput. The files are read into memory first, so only
+ * parsing is timed - including the copy into the ParameterFile.
+ */
+
+#include <il2ge/parameter_file.h>
+#include <util.h>
+
+#include <filesystem>
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+using namespace std;
+using Clock = std::chrono::steady_clock;
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+
+struct InputFile
+{
+  string path;
+  vector<char> content;
+};
+
+
+vector<InputFile> readFiles(const string &dir)
+{
+  vector<InputFile> files;
+
+  for (auto &entry : fs::recursive_directory_iterator(dir))
+  {
+    if (!entry.is_regular_file())
+      continue;
+
+    auto extension = util::makeLowercase(entry.path().extension().string());
+    if (extension != ".eff" && extension != ".mat")
+      continue;
+
+    InputFile file;
+    file.path = entry.path().string();
+    file.content = util::readFile<char>(file.path);
+
+    files.push_back(move(file));
+  }
+
+  return files;
+}
+
+
+// returns the number of parsed sections
+size_t parse(const InputFile &file)
+{
+  il2ge::ParameterFile parameter_file(file.content.data(), file.content.size());
+  return parameter_file.getSections().size();
+}
+
+
+} // namespace
+
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    cerr << "Usage: il2ge_parameter_file_bench <directory> [iterations]" << endl;
+    return 1;
+  }
+
+  const int num_iterations = argc > 2 ? max(1, atoi(argv[2])) : 10;
+
+  vector<InputFile> files;
+
+  try
+  {
+    files = readFiles(argv[1]);
+  }
+  catch (std::exception &e)
+  {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
+  // files that fail to parse are reported once and left out of the timing
+  size_t num_failed = 0;
+
+  files.erase(remove_if(files.begin(), files.end(), [&num_failed] (auto &file)
+  {
+    try
+    {
+      parse(file);
+      return false;
+    }
+    catch (std::exception &e)
+    {
+      cerr << file.path << ": " << e.what() << endl;
+      num_failed++;
+      return true;
+    }
+  }), files.end());
+
+  if (files.empty())
+  {
+    cerr << "No parseable .eff or .mat files in " << argv[1] << endl;
+    return 1;
+  }
+
+  size_t num_bytes = 0;
+  for (auto &file : files)
+    num_bytes += file.content.size();
+
+  double best_seconds = 0;
+  double total_seconds = 0;
+  size_t num_sections = 0;
+
+  for (int i = 0; i < num_iterations; i++)
+  {
+    auto start_time = Clock::now();
+
+    num_sections = 0;
+    for (auto &file : files)
+      num_sections += parse(file);
+
+    double seconds = chrono::duration<double>(Clock::now() - start_time).count();
+
+    total_seconds += seconds;
+    if (i == 0 || seconds < best_seconds)
+      best_seconds = seconds;
+  }
+
+  const double mb = num_bytes / (1024.0 * 1024.0);
+
+  cout << files.size() << " files, " << num_bytes / 1024 << " KB, "
+       << num_sections << " sections, " << num_failed << " failed to parse" << endl;
+  cout << num_iterations << " iterations - best: " << best_seconds * 1000 << " ms, "
+       << "mean: " << total_seconds / num_iterations * 1000 << " ms" << endl;
+  cout << "best: " << mb / best_seconds << " MB/s, "
+       << files.size() / best_seconds << " files/s" << endl;
+
+  return 0;
+}
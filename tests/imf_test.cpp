@@ -0,0 +1,146 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Decodes the IMF fixtures in data/imf with every row filter implementation
+ * and compares the result with the golden RGBA output next to each fixture.
+ * The golden outputs were produced by the original (pre-streaming) decoder.
+ */
+
+#include <imf.h>
+#include <imf_filters.h>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+
+
+const char *const FIXTURES[] =
+{
+  "up",
+  "average",
+  "paeth",
+  "mixed_rgb",
+};
+
+
+bool readFile(const string &path, vector<char> &content)
+{
+  ifstream file(path, ios::binary);
+  if (!file)
+    return false;
+  content.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+  return true;
+}
+
+
+bool test(const string &dir, const string &fixture,
+          const char *filters_name, const il2ge::imf::RowFilters &filters)
+{
+  auto name = fixture + " (" + filters_name + ")";
+
+  vector<char> imf;
+  vector<char> golden;
+
+  if (!readFile(dir + "/" + fixture + ".imf", imf) ||
+      !readFile(dir + "/" + fixture + ".rgba", golden))
+  {
+    cerr << "FAIL " << name << ": can't read fixture" << endl;
+    return false;
+  }
+
+  int w = 0;
+  int h = 0;
+  if (!getIMFInfo(imf.data(), imf.size(), w, h) || golden.size() != size_t(w) * h * 4)
+  {
+    cerr << "FAIL " << name << ": unexpected size" << endl;
+    return false;
+  }
+
+  const size_t row_size = size_t(w) * 4;
+
+  vector<unsigned char> decoded(golden.size());
+  vector<unsigned char> flipped(golden.size());
+
+  if (!decodeIMF(imf.data(), imf.size(), decoded.data(), decoded.size(), false, name, filters) ||
+      !decodeIMF(imf.data(), imf.size(), flipped.data(), flipped.size(), true, name, filters))
+  {
+    cerr << "FAIL " << name << ": decoding failed" << endl;
+    return false;
+  }
+
+  for (int y = 0; y < h; y++)
+  {
+    auto expected = golden.data() + y * row_size;
+
+    if (memcmp(decoded.data() + y * row_size, expected, row_size) != 0 ||
+        memcmp(flipped.data() + (h - 1 - y) * row_size, expected, row_size) != 0)
+    {
+      cerr << "FAIL " << name << ": row " << y << " differs" << endl;
+      return false;
+    }
+  }
+
+  // a truncated file must be rejected
+  if (decodeIMF(imf.data(), imf.size() - 1, decoded.data(), decoded.size(), false, name, filters))
+  {
+    cerr << "FAIL " << name << ": truncated file accepted" << endl;
+    return false;
+  }
+
+  cout << "OK " << name << endl;
+  return true;
+}
+
+
+} // namespace
+
+
+int main(int argc, char **argv)
+{
+  if (argc != 2)
+  {
+    cerr << "usage: " << argv[0] << " <fixture dir>" << endl;
+    return 1;
+  }
+
+  string dir = argv[1];
+
+  bool success = true;
+
+  auto sse2 = il2ge::imf::getSSE2RowFilters();
+  if (!sse2)
+    cout << "SSE2 row filters not supported - skipped" << endl;
+
+  for (auto fixture : FIXTURES)
+  {
+    success &= test(dir, fixture, "scalar", il2ge::imf::getScalarRowFilters());
+    if (sse2)
+      success &= test(dir, fixture, "SSE2", *sse2);
+  }
+
+  return success ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+/**
+ *    IL-2 Graphics Extender
+ *    Copyright (C) 2019 Jan Lepper
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Reads through sfs::File / sfs::readFile() with the directory backend
+ * and checks the LRU content cache - no game required.
+ */
+
+#include <sfs.h>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <cstring>
+
+using namespace std;
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+
+bool g_success = true;
+
+
+void check(bool condition, const char *what)
+{
+  cout << (condition ? "OK " : "FAIL ") << what << endl;
+  g_success &= condition;
+}
+
+
+vector<char> createContent(size_t size, int seed)
+{
+  vector<char> content(size);
+  for (size_t i = 0; i < size; i++)
+    content[i] = char((i * 31 + seed) & 0xFF);
+  return content;
+}
+
+
+void writeFile(const fs::path &path, const vector<char> &content)
+{
+  fs::create_directories(path.parent_path());
+  ofstream file(path, ios::binary);
+  file.write(content.data(), content.size());
+}
+
+
+void testFiles(const vector<char> &small, const vector<char> &big)
+{
+  vector<char> content;
+
+  check(sfs::readFile("maps/Test/load.ini", content) && content == small,
+        "readFile() with a different case");
+  check(sfs::readFile("MAPS/other/../TEST/LOAD.INI", content) && content == small,
+        "readFile() with relative path components");
+  check(!sfs::readFile("maps/test/missing.ini", content), "readFile() of a missing file");
+
+  long size = 0;
+  check(sfs::getFileSize("big.bin", size) && size == long(big.size()), "getFileSize()");
+
+  sfs::File file("big.bin");
+  check(file.getSize() == int(big.size()), "File::getSize()");
+
+  // crosses the read-ahead buffer
+  vector<char> part(1000);
+  long offset = 64 * 1024 - 300;
+  check(file.readAt(offset, part.data(), part.size()) == int(part.size()) &&
+        memcmp(part.data(), big.data() + offset, part.size()) == 0,
+        "File::readAt() across the read-ahead buffer");
+
+  file.skip(10);
+  check(file.read(part.data(), 20) == 20 && memcmp(part.data(), big.data() + 10, 20) == 0,
+        "File::skip() and File::read()");
+
+  file.readAll(content);
+  check(content == big, "File::readAll()");
+
+  file.rewind();
+  vector<char> sequential(big.size());
+  int total = 0;
+  while (!file.eof())
+    total += file.read(sequential.data() + total, 4000);
+  check(total == int(big.size()) && sequential == big, "sequential File::read()");
+}
+
+
+void testCache(const fs::path &root, const vector<char> &small)
+{
+  vector<char> content;
+
+  sfs::clearCache();
+  sfs::setCacheBudget(0);
+  check(sfs::readFile("maps/test/load.ini", content) && sfs::getCacheStats().misses == 0,
+        "cache disabled with a budget of 0");
+
+  sfs::setCacheBudget(10 * 1024);
+
+  sfs::readFile("maps/test/load.ini", content);
+
+  // served from the cache from now on
+  writeFile(root / "Maps/Test/Load.ini", createContent(small.size(), 99));
+
+  check(sfs::readFile("maps/test/load.ini", content) && content == small,
+        "cached content is returned");
+
+  auto stats = sfs::getCacheStats();
+  check(stats.hits == 1 && stats.misses == 1 && stats.num_entries == 1 &&
+        stats.size == small.size(),
+        "cache stats after a hit");
+
+  // bigger than a quarter of the budget
+  check(sfs::readFile("big.bin", content) && sfs::getCacheStats().num_entries == 1,
+        "big files are not cached");
+
+  for (int i = 0; i < 8; i++)
+    sfs::readFile("files/" + to_string(i) + ".dat", content);
+
+  stats = sfs::getCacheStats();
+  check(stats.evictions > 0 && stats.size <= stats.budget, "least recently used files are evicted");
+
+  check(sfs::readFile("maps/test/load.ini", content) && content != small,
+        "evicted files are read again");
+
+  sfs::setCacheBudget(0);
+  check(sfs::getCacheStats().num_entries == 0, "setting a budget of 0 empties the cache");
+}
+
+
+} // namespace
+
+
+int main()
+{
+  auto root = fs::temp_directory_path() / "il2ge_sfs_test";
+  fs::remove_all(root);
+
+  auto small = createContent(2000, 1);
+  auto big = createContent(200 * 1024, 2);
+
+  writeFile(root / "Maps/Test/Load.ini", small);
+  writeFile(root / "big.bin", big);
+  for (int i = 0; i < 8; i++)
+    writeFile(root / "files" / (to_string(i) + ".dat"), createContent(2000, i));
+
+  sfs::setBackend(sfs::createDirectoryBackend(root.string()));
+
+  testFiles(small, big);
+  testCache(root, small);
+
+  fs::remove_all(root);
+
+  return g_success ? 0 : 1;
+}